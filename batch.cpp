@@ -0,0 +1,220 @@
+#include "batch.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+#include "player.h"
+using namespace std;
+
+/*
+ * Input lines are a 64-character board, as read by Board::setBoard, and the
+ * side to move ('b' or 'w'), separated by whitespace; anything after that
+ * is ignored. Output lines are space-separated key=value pairs:
+ *
+ *   position=12 move=3,2 score=6 exact=0 depth=9 nodes=81234 time_ms=27
+ *
+ * A pass is move=-1,-1, and a line that is not a position gives
+ * "position=N error=bad_position", or "position=N error=long_line" if it is
+ * longer than BATCH_LINE characters.
+ */
+
+// Positions in memory per worker
+static const int BATCH_WINDOW = 4;
+// Longest input line read
+static const int BATCH_LINE = 255;
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+struct BatchJob {
+    Board board;
+    Side side;
+    // NULL, or the error printed for the line instead of a result
+    const char *error;
+    bool done;
+    int move;
+    SearchStats stats;
+    unsigned long nodes;
+    long time;
+};
+
+/*
+ * Ring of BATCH_WINDOW jobs per worker. Jobs are read in at next_read,
+ * handed to workers from next_job, and printed from next_print, each in
+ * order; a slot is only reused once its job has been printed.
+ */
+struct BatchQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    vector<BatchJob> jobs;
+    unsigned long next_read;
+    unsigned long next_job;
+    unsigned long next_print;
+    bool eof;
+
+    int depth;
+    int ms;
+    int endgame_empties;
+};
+
+/**
+ * Reads a board of exactly 64 characters and a side to move, each a word
+ * of its own, from the start of line.
+ */
+static bool parsePosition(const char *line, BatchJob &job) {
+    char data[66];
+    char side;
+    int end = 0;
+    if (sscanf(line, "%65s %c%n", data, &side, &end) != 2
+            || strlen(data) != 64 || (side != 'b' && side != 'w')
+            || (line[end] != '\0' && !isspace((unsigned char) line[end]))) {
+        return false;
+    }
+    job.board.setBoard(data);
+    job.side = (side == 'b') ? BLACK : WHITE;
+    return true;
+}
+
+static void *batchWorker(void *arg) {
+    BatchQueue *queue = (BatchQueue *) arg;
+    Player player(BLACK);
+    player.search_depth = queue->depth;
+    player.move_time = queue->ms;
+    player.endgame_depth = queue->endgame_empties;
+
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->next_job == queue->next_read && !queue->eof) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        if (queue->next_job == queue->next_read) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        BatchJob &job = queue->jobs[queue->next_job % queue->jobs.size()];
+        queue->next_job++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (job.error == NULL) {
+            // Nothing carries over from the worker's earlier positions
+            player.clearSearch();
+            long start = currentTimeMs();
+            job.move = player.findMove(job.board, job.side, -1);
+            job.time = currentTimeMs() - start;
+            job.stats = player.stats;
+            job.nodes = player.totalNodes();
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        job.done = true;
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Prints the jobs that are done at the head of the queue. Called with the
+ * lock held.
+ */
+static void printDone(BatchQueue &queue) {
+    while (queue.next_print < queue.next_job) {
+        BatchJob &job = queue.jobs[queue.next_print % queue.jobs.size()];
+        if (!job.done) {
+            break;
+        }
+        if (job.error != NULL) {
+            printf("position=%lu error=%s\n", queue.next_print, job.error);
+        } else {
+            printf("position=%lu move=%d,%d score=%d exact=%d depth=%d "
+                    "nodes=%lu time_ms=%ld\n", queue.next_print,
+                    job.move == Player::NO_MOVE ? -1 : job.move % 8,
+                    job.move == Player::NO_MOVE ? -1 : job.move / 8,
+                    job.stats.score, job.stats.exact ? 1 : 0,
+                    job.stats.depth, job.nodes, job.time);
+        }
+        queue.next_print++;
+    }
+    fflush(stdout);
+}
+
+int runBatch(int depth, int threads, int ms, int endgame_empties) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    BatchQueue queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.changed, NULL);
+    queue.jobs.resize(BATCH_WINDOW * threads);
+    queue.next_read = queue.next_job = queue.next_print = 0;
+    queue.eof = false;
+    queue.depth = depth;
+    queue.ms = ms;
+    queue.endgame_empties = endgame_empties;
+
+    vector<pthread_t> workers(threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, batchWorker, &queue);
+    }
+
+    char line[BATCH_LINE + 2];
+    while (true) {
+        // Wait for a free slot, printing what is done meanwhile
+        pthread_mutex_lock(&queue.lock);
+        printDone(queue);
+        while (queue.next_read - queue.next_print == queue.jobs.size()) {
+            pthread_cond_wait(&queue.changed, &queue.lock);
+            printDone(queue);
+        }
+        pthread_mutex_unlock(&queue.lock);
+
+        if (!fgets(line, sizeof(line), stdin)) {
+            break;
+        }
+        // Skip the rest of a line too long for the buffer, so it is only
+        // reported once
+        bool long_line = !strchr(line, '\n') && !feof(stdin);
+        if (long_line) {
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF) {
+            }
+        }
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        BatchJob &job = queue.jobs[queue.next_read % queue.jobs.size()];
+        if (long_line) {
+            job.error = "long_line";
+        } else {
+            job.error = parsePosition(line, job) ? NULL : "bad_position";
+        }
+        job.done = false;
+
+        pthread_mutex_lock(&queue.lock);
+        queue.next_read++;
+        pthread_cond_broadcast(&queue.changed);
+        pthread_mutex_unlock(&queue.lock);
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.eof = true;
+    pthread_cond_broadcast(&queue.changed);
+    printDone(queue);
+    while (queue.next_print < queue.next_read) {
+        pthread_cond_wait(&queue.changed, &queue.lock);
+        printDone(queue);
+    }
+    pthread_mutex_unlock(&queue.lock);
+
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_cond_destroy(&queue.changed);
+    pthread_mutex_destroy(&queue.lock);
+    return 0;
+}
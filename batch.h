@@ -0,0 +1,17 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/*
+ * Batch analysis: reads positions from stdin, one per line, and writes the
+ * best move and score of each to stdout, in the same order. Each of
+ * "threads" workers searches with a player of its own; at most
+ * BATCH_WINDOW positions per worker are held in memory at once.
+ *
+ * Positions are searched to "depth", or for ms milliseconds each if ms is
+ * positive, and solved exactly with endgame_empties or fewer empty squares.
+ * Every search starts from an empty transposition table, so a depth search
+ * gives the same result whatever the thread count or the other positions.
+ */
+int runBatch(int depth, int threads, int ms, int endgame_empties);
+
+#endif
@@ -0,0 +1,377 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/time.h>
+#include "player.h"
+using namespace std;
+
+/*
+ * Benchmarks for the engine. Results are printed one line per measurement
+ * as space-separated key=value pairs, so runs can be compared by scripts.
+ *
+ *   bench perft [depth]
+ *       Counts the leaves of the legal move tree from the starting position
+ *       to each depth up to the given one, and checks them against the
+ *       known counts. A pass counts as a move; a finished game is a leaf.
+ *       Then does the same, as far as their counts are known, from a
+ *       midgame position, one where the side to move has to pass, and one
+ *       where the game is over.
+ *
+ *   bench search [depth]
+ *       Searches a fixed set of positions to the given depth on one thread
+ *       and reports nodes, nodes per second, time to depth and the
+ *       effective branching factor of the last iteration, per position and
+ *       in total.
+ *
+ *   bench endgame [file]
+ *       Solves every position in the file (endgame.txt by default) exactly,
+ *       checks the score and that the move found keeps it, and reports the
+ *       nodes and time per position, then a summary per number of empties.
+ *
+ *   bench smp [max_threads] [depth]
+ *       Time to search a fixed set of midgame positions to the given depth
+ *       with 1, 2, 4, ... up to max_threads threads, and the speedup over
+ *       one thread.
+ */
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+/*
+ * Plays uniformly random legal moves from the starting position until the
+ * given number of empty squares is left. The generator is seeded per
+ * position, so every run benchmarks the same positions.
+ */
+static Board randomPosition(unsigned int seed, int empties, Side &side) {
+    Board board;
+    side = BLACK;
+    while (64 - board.countAll() > empties) {
+        uint64_t moves = board.moveMask(side);
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        if (moves == 0) {
+            if (board.moveMask(other) == 0) {
+                break;
+            }
+            side = other;
+            continue;
+        }
+        seed = seed * 1103515245 + 12345;
+        int pick = (seed >> 16) % bitCount(moves);
+        while (pick--) {
+            moves &= moves - 1;
+        }
+        board.doMove(firstSquare(moves), side);
+        side = other;
+    }
+    return board;
+}
+
+/*
+ * Positions for perft, as read by Board::setBoard, with the leaf counts of
+ * their move trees by depth as far as they are known. The counts beyond the
+ * starting position were checked with a plain array-based move generator.
+ */
+static const int PERFT_MAX_KNOWN = 12;
+
+struct PerftPosition {
+    const char *name;
+    const char *board;
+    Side side;
+    int known;
+    unsigned long counts[PERFT_MAX_KNOWN];
+};
+
+static const PerftPosition PERFT_POSITIONS[] = {
+    {"start",
+     "---------------------------wb------bw---------------------------",
+     BLACK, 12, {1, 4, 12, 56, 244, 1396, 8200, 55092, 390216, 3005288,
+         24571284, 212258800}},
+    {"midgame",
+     "---------b---b----bbb-----bbb-----wwwbwwbwbbbbb-w---wwwb------bw",
+     BLACK, 7, {1, 10, 139, 1322, 18531, 180104, 2497710}},
+    // White has no move, so every line starts with a pass
+    {"pass",
+     "wwwbbbbbwwbbbwbb-wwbwbwb--wwbwwb--wwwbwb-wwwwwwb--wwwwbb-----wbb",
+     WHITE, 11, {1, 1, 11, 33, 306, 1181, 8777, 36834, 209136, 792421,
+         3233390}},
+    // Neither side can move, with empty squares left
+    {"game_over",
+     "w--bbbbb---bbbbb---bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb",
+     BLACK, 12, {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}}
+};
+static const int PERFT_COUNT =
+    sizeof(PERFT_POSITIONS) / sizeof(PERFT_POSITIONS[0]);
+
+static unsigned long perft(uint64_t own, uint64_t opp, int depth,
+        bool passed) {
+    if (depth == 0) {
+        return 1;
+    }
+    uint64_t moves = Board::legalMoves(own, opp);
+    if (moves == 0) {
+        if (passed) {
+            return 1;
+        }
+        return perft(opp, own, depth - 1, true);
+    }
+    if (depth == 1) {
+        return bitCount(moves);
+    }
+    unsigned long leaves = 0;
+    while (moves) {
+        int square = firstSquare(moves);
+        moves &= moves - 1;
+        uint64_t flips = Board::flipMask(own, opp, square);
+        leaves += perft(opp ^ flips, own ^ flips ^ squareBit(square),
+                depth - 1, false);
+    }
+    return leaves;
+}
+
+static int benchPerft(int max_depth) {
+    int failures = 0;
+    for (int i = 0; i < PERFT_COUNT; i++) {
+        const PerftPosition &position = PERFT_POSITIONS[i];
+        uint64_t own = 0, opp = 0;
+        char mine = (position.side == BLACK) ? 'b' : 'w';
+        for (int square = 0; square < 64; square++) {
+            if (position.board[square] == mine) {
+                own |= squareBit(square);
+            } else if (position.board[square] != '-') {
+                opp |= squareBit(square);
+            }
+        }
+        // Only the starting position goes on past its known counts
+        int last = max_depth;
+        if (i > 0 && last >= position.known) {
+            last = position.known - 1;
+        }
+
+        for (int depth = 1; depth <= last; depth++) {
+            long start = currentTimeMs();
+            unsigned long leaves = perft(own, opp, depth, false);
+            long time = currentTimeMs() - start;
+            const char *result = "unknown";
+            if (depth < position.known) {
+                if (leaves == position.counts[depth]) {
+                    result = "ok";
+                } else {
+                    result = "FAIL";
+                    failures++;
+                }
+            }
+            printf("bench=perft position=%s depth=%d leaves=%lu time_ms=%ld "
+                    "lps=%.0f result=%s\n", position.name, depth, leaves,
+                    time, time > 0 ? leaves * 1000.0 / time : 0.0, result);
+            fflush(stdout);
+        }
+    }
+    return failures ? 1 : 0;
+}
+
+/*
+ * Positions for the search benchmark: a few from each stage of the game.
+ */
+static const int SEARCH_POSITIONS = 4;
+static const int SEARCH_EMPTIES[] = {48, 40, 32, 24};
+static const int SEARCH_STAGES = sizeof(SEARCH_EMPTIES) / sizeof(int);
+
+static int benchSearch(int depth) {
+    Player player(BLACK);
+    player.search_depth = depth;
+    player.endgame_depth = 0;
+
+    long total_time = 0;
+    unsigned long total_nodes = 0;
+    double total_ebf = 0;
+    int positions = 0;
+    for (int stage = 0; stage < SEARCH_STAGES; stage++) {
+        for (int i = 0; i < SEARCH_POSITIONS; i++) {
+            Side side;
+            int empties = SEARCH_EMPTIES[stage];
+            Board board = randomPosition(100 * stage + i + 1, empties, side);
+            player.tt->clear();
+            long start = currentTimeMs();
+            player.findMove(board, side, -1);
+            long time = currentTimeMs() - start;
+            const SearchStats &stats = player.stats;
+            printf("bench=search position=%d empties=%d depth=%d time_ms=%ld "
+                    "nodes=%lu nps=%.0f ebf=%.2f first_cutoff=%.3f\n",
+                    positions, empties, stats.depth, time, stats.nodes,
+                    time > 0 ? stats.nodes * 1000.0 / time : 0.0,
+                    stats.branchingFactor(),
+                    stats.cutoffs > 0 ? (double) stats.first_move_cutoffs
+                        / stats.cutoffs : 0.0);
+            fflush(stdout);
+            total_time += time;
+            total_nodes += stats.nodes;
+            total_ebf += stats.branchingFactor();
+            positions++;
+        }
+    }
+    printf("bench=search summary=1 depth=%d positions=%d time_ms=%ld "
+            "nodes=%lu nps=%.0f ebf=%.2f\n", depth, positions, total_time,
+            total_nodes,
+            total_time > 0 ? total_nodes * 1000.0 / total_time : 0.0,
+            total_ebf / positions);
+    return 0;
+}
+
+/*
+ * Solves the positions in an endgame file. Each line holds a 64-character
+ * board as read by Board::setBoard, the side to move ('b' or 'w') and the
+ * exact score; blank lines and lines starting with '#' are skipped.
+ */
+static int benchEndgame(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        cerr << "cannot open " << filename << endl;
+        return 1;
+    }
+
+    Player player(BLACK);
+    long times[65], max_times[65];
+    unsigned long nodes[65];
+    int counts[65];
+    memset(times, 0, sizeof(times));
+    memset(max_times, 0, sizeof(max_times));
+    memset(nodes, 0, sizeof(nodes));
+    memset(counts, 0, sizeof(counts));
+    int positions = 0, failures = 0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char data[65];
+        char side_char;
+        int expected;
+        if (line[0] == '#' || line[0] == '\n'
+                || sscanf(line, "%64s %c %d", data, &side_char, &expected) != 3
+                || strlen(data) != 64) {
+            continue;
+        }
+        Board board;
+        board.setBoard(data);
+        Side side = (side_char == 'w') ? WHITE : BLACK;
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        int empties = 64 - board.countAll();
+
+        player.tt->clear();
+        player.stats = SearchStats();
+        int best_move;
+        long start = currentTimeMs();
+        int score = player.minimax_endgame(board, side, -64, 64, best_move);
+        long time = currentTimeMs() - start;
+        unsigned long position_nodes = player.stats.nodes;
+
+        // The move found must be worth the score found
+        bool move_ok = false;
+        if (best_move != Player::NO_MOVE
+                && (board.moveMask(side) & squareBit(best_move))) {
+            Board child = board;
+            child.doMove(best_move, side);
+            int garbage;
+            move_ok = -player.minimax_endgame(child, other, -score - 1,
+                    -score + 1, garbage) == score;
+        }
+        bool ok = (score == expected) && move_ok;
+        if (!ok) {
+            failures++;
+        }
+
+        printf("bench=endgame position=%d empties=%d score=%d expected=%d "
+                "move=%d,%d time_ms=%ld nodes=%lu nps=%.0f result=%s\n",
+                positions, empties, score, expected,
+                best_move == Player::NO_MOVE ? -1 : best_move % 8,
+                best_move == Player::NO_MOVE ? -1 : best_move / 8, time,
+                position_nodes,
+                time > 0 ? position_nodes * 1000.0 / time : 0.0,
+                ok ? "ok" : "FAIL");
+        fflush(stdout);
+
+        counts[empties]++;
+        times[empties] += time;
+        nodes[empties] += position_nodes;
+        if (time > max_times[empties]) {
+            max_times[empties] = time;
+        }
+        positions++;
+    }
+    fclose(file);
+
+    long total_time = 0;
+    for (int empties = 0; empties <= 64; empties++) {
+        if (counts[empties] == 0) {
+            continue;
+        }
+        printf("bench=endgame summary=1 empties=%d positions=%d "
+                "mean_time_ms=%.1f max_time_ms=%ld mean_nodes=%.0f\n",
+                empties, counts[empties],
+                (double) times[empties] / counts[empties], max_times[empties],
+                (double) nodes[empties] / counts[empties]);
+        total_time += times[empties];
+    }
+    printf("bench=endgame summary=1 positions=%d failures=%d time_ms=%ld\n",
+            positions, failures, total_time);
+    return failures ? 1 : 0;
+}
+
+static const int SMP_POSITIONS = 8;
+static const int SMP_EMPTIES = 40;
+
+static int benchSmp(int max_threads, int depth) {
+    long base_time = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        Player player(BLACK);
+        player.setThreads(threads);
+        player.search_depth = depth;
+        player.endgame_depth = 0;
+
+        long time = 0;
+        unsigned long nodes = 0;
+        for (int i = 0; i < SMP_POSITIONS; i++) {
+            Side side;
+            Board board = randomPosition(i + 1, SMP_EMPTIES, side);
+            player.tt->clear();
+            long start = currentTimeMs();
+            player.findMove(board, side, -1);
+            time += currentTimeMs() - start;
+            nodes += player.totalNodes();
+        }
+        if (threads == 1) {
+            base_time = time;
+        }
+        printf("bench=smp threads=%d depth=%d positions=%d time_ms=%ld "
+                "nodes=%lu nps=%.0f speedup=%.2f\n", threads, depth,
+                SMP_POSITIONS, time, nodes,
+                time > 0 ? nodes * 1000.0 / time : 0.0,
+                time > 0 ? (double) base_time / time : 0.0);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && !strcmp(argv[1], "perft")) {
+        return benchPerft((argc >= 3) ? atoi(argv[2]) : 9);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "search")) {
+        return benchSearch((argc >= 3) ? atoi(argv[2]) : 9);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "endgame")) {
+        return benchEndgame((argc >= 3) ? argv[2] : "endgame.txt");
+    }
+    if (argc >= 2 && !strcmp(argv[1], "smp")) {
+        int max_threads = (argc >= 3) ? atoi(argv[2]) : 8;
+        int depth = (argc >= 4) ? atoi(argv[3]) : 9;
+        return benchSmp(max_threads, depth);
+    }
+
+    cerr << "usage: " << argv[0] << " perft [depth]" << endl
+        << "       " << argv[0] << " search [depth]" << endl
+        << "       " << argv[0] << " endgame [file]" << endl
+        << "       " << argv[0] << " smp [max_threads] [depth]" << endl;
+    return 1;
+}
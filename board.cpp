@@ -1,17 +1,20 @@
 #include "board.h"
 #include <iostream>
+#include <cassert>
+#include <cstring>
 using namespace std;
 
+static void initStability();
+
 /**
  * Make a standard 8x8 othello board and initialize it to the standard setup.
  */
 Board::Board() {
-    taken.set(3 + 8 * 3);
-    taken.set(3 + 8 * 4);
-    taken.set(4 + 8 * 3);
-    taken.set(4 + 8 * 4);
-    black.set(4 + 8 * 3);
-    black.set(3 + 8 * 4);
+    black = squareBit(4 + 8 * 3) | squareBit(3 + 8 * 4);
+    white = squareBit(3 + 8 * 3) | squareBit(4 + 8 * 4);
+    Patterns::init();
+    Patterns::index(black, white, patterns);
+    initStability();
 }
 
 /**
@@ -37,54 +40,474 @@ const int Board::heuristic_values[64] =
 
 
 
-/*
- * Returns a copy of this board.
- */
-Board *Board::copy() {
-    Board *newBoard = new Board();
-    newBoard->black = black;
-    newBoard->taken = taken;
-    return newBoard;
-}
-
 /**
 Returns whether (x, y) is occupied.
 */
-bool Board::occupied(int x, int y) {
-    return taken[x + 8*y];
+bool Board::occupied(int x, int y) const {
+    return (black | white) & squareBit(x + 8*y);
 }
 
 /**
 Returns whether (x, y) is occupied by the specified side.
 */
-bool Board::get(Side side, int x, int y) {
-    return occupied(x, y) && (black[x + 8*y] == (side == BLACK));
+bool Board::get(Side side, int x, int y) const {
+    return pieces(side) & squareBit(x + 8*y);
 }
 
 /**
 Sets position (x, y) to be occupied by the specified side.
 */
 void Board::set(Side side, int x, int y) {
-    taken.set(x + 8*y);
-    black.set(x + 8*y, side == BLACK);
+    uint64_t bit = squareBit(x + 8*y);
+    if (side == BLACK) {
+        black |= bit;
+        white &= ~bit;
+    } else {
+        white |= bit;
+        black &= ~bit;
+    }
+}
+
+/*
+ * Shift amounts for the eight directions, and the mask of squares a run of
+ * opponent stones may occupy in each direction. Runs going east or west must
+ * stop short of the a- and h-files, otherwise a shift would wrap around to
+ * the next row.
+ */
+static const int DIRECTION_SHIFTS[8] = {1, -1, 8, -8, 9, -9, 7, -7};
+static const uint64_t DIRECTION_MASKS[8] = {
+    UINT64_C(0x7E7E7E7E7E7E7E7E), UINT64_C(0x7E7E7E7E7E7E7E7E),
+    UINT64_C(0xFFFFFFFFFFFFFFFF), UINT64_C(0xFFFFFFFFFFFFFFFF),
+    UINT64_C(0x7E7E7E7E7E7E7E7E), UINT64_C(0x7E7E7E7E7E7E7E7E),
+    UINT64_C(0x7E7E7E7E7E7E7E7E), UINT64_C(0x7E7E7E7E7E7E7E7E)
+};
+
+static inline uint64_t shift(uint64_t b, int amount) {
+    return (amount > 0) ? (b << amount) : (b >> -amount);
 }
 
 /**
-Flip a single piece at the specified position. Assumes the position is
-occupied; i.e. there is something to flip there.
-*/
-void Board::flip(int x, int y) {
-    black.flip(x + 8*y);
+ * Returns the squares reached by sliding every bit of "from" along a run of
+ * "mask" squares in the given direction, i.e. the run itself. Runs on an
+ * 8x8 board are at most 6 long, so six shift-and-mask steps are enough.
+ */
+static inline uint64_t run(uint64_t from, uint64_t mask, int amount) {
+    uint64_t t = shift(from, amount) & mask;
+    t |= shift(t, amount) & mask;
+    t |= shift(t, amount) & mask;
+    t |= shift(t, amount) & mask;
+    t |= shift(t, amount) & mask;
+    t |= shift(t, amount) & mask;
+    return t;
 }
 
 /**
-Returns whether (x, y) is on the board.
-*/
-bool Board::onBoard(int x, int y) {
-    return(0 <= x && x < 8 && 0 <= y && y < 8);
+ * Same as run, as a parallel prefix: after two single steps, runs are
+ * extended two squares at a time through pairs of adjacent mask squares,
+ * which takes five shifts instead of six and shortens the dependency chain.
+ */
+static inline uint64_t runPrefix(uint64_t from, uint64_t mask, int amount) {
+    uint64_t t = shift(from, amount) & mask;
+    t |= shift(t, amount) & mask;
+    uint64_t pairs = mask & shift(mask, amount);
+    t |= shift(t, 2 * amount) & pairs;
+    t |= shift(t, 2 * amount) & pairs;
+    return t;
+}
+
+/**
+ * Returns the mask of empty squares where "own" may legally play against
+ * "opp": every direction from an own stone through a run of opponent stones
+ * that ends on an empty square.
+ */
+uint64_t Board::legalMoves(uint64_t own, uint64_t opp) {
+    uint64_t empty = ~(own | opp);
+    uint64_t moves = 0;
+    for (int d = 0; d < 8; d++) {
+        uint64_t t = runPrefix(own, opp & DIRECTION_MASKS[d],
+                DIRECTION_SHIFTS[d]);
+        moves |= shift(t, DIRECTION_SHIFTS[d]) & empty;
+    }
+    return moves;
+}
+
+/**
+ * Returns the mask of squares next to any of the given squares, in any of
+ * the eight directions.
+ */
+uint64_t Board::neighbours(uint64_t squares) {
+    const uint64_t not_a_file = UINT64_C(0xFEFEFEFEFEFEFEFE);
+    const uint64_t not_h_file = UINT64_C(0x7F7F7F7F7F7F7F7F);
+    uint64_t sideways = ((squares << 1) & not_a_file)
+        | ((squares >> 1) & not_h_file);
+    uint64_t row = squares | sideways;
+    return sideways | (row << 8) | (row >> 8);
+}
+
+/**
+ * Returns the mask of opponent stones flipped when "own" plays on the given
+ * square. Zero means the move is illegal (assuming the square is empty).
+ */
+uint64_t Board::flipMask(uint64_t own, uint64_t opp, int square) {
+    uint64_t move = squareBit(square);
+    uint64_t flips = 0;
+    for (int d = 0; d < 8; d++) {
+        uint64_t t = run(move, opp & DIRECTION_MASKS[d], DIRECTION_SHIFTS[d]);
+        if (shift(t, DIRECTION_SHIFTS[d]) & own) {
+            flips |= t;
+        }
+    }
+    return flips;
+}
+
+/**
+ * Stones of the given side.
+ */
+uint64_t Board::pieces(Side side) const {
+    return (side == BLACK) ? black : white;
+}
+
+/**
+ * Mask of empty squares.
+ */
+uint64_t Board::empties() const {
+    return ~(black | white);
+}
+
+/**
+ * Mask of legal moves for the given side.
+ */
+uint64_t Board::moveMask(Side side) const {
+    return (side == BLACK) ? legalMoves(black, white)
+                           : legalMoves(white, black);
+}
+
+/**
+ * 64-bit finalizer from SplitMix64; every input bit affects every output bit.
+ */
+static inline uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/**
+ * Returns a hash of the position with "own" to move, for keying the
+ * transposition table. It is computed from the two bitboards, so it does
+ * not need to be updated as moves are made.
+ */
+uint64_t Board::hash(uint64_t own, uint64_t opp) {
+    return mix(own ^ mix(opp));
+}
+
+/**
+ * Returns a hash of the position with the given side to move. Colors do
+ * not matter to the search, so this is the same as the hash of the
+ * position with the colors swapped.
+ */
+uint64_t Board::hash(Side side) const {
+    return (side == BLACK) ? hash(black, white) : hash(white, black);
+}
+
+/*
+ * Delta swap kernels for the symmetries: transposition about the a1-h8
+ * diagonal, and mirroring left to right.
+ */
+static inline uint64_t transpose(uint64_t b) {
+    uint64_t t;
+    t = UINT64_C(0x0F0F0F0F00000000) & (b ^ (b << 28));
+    b ^= t ^ (t >> 28);
+    t = UINT64_C(0x3333000033330000) & (b ^ (b << 14));
+    b ^= t ^ (t >> 14);
+    t = UINT64_C(0x5500550055005500) & (b ^ (b << 7));
+    b ^= t ^ (t >> 7);
+    return b;
+}
+
+static inline uint64_t mirror(uint64_t b) {
+    b = ((b >> 1) & UINT64_C(0x5555555555555555))
+        | ((b & UINT64_C(0x5555555555555555)) << 1);
+    b = ((b >> 2) & UINT64_C(0x3333333333333333))
+        | ((b & UINT64_C(0x3333333333333333)) << 2);
+    b = ((b >> 4) & UINT64_C(0x0F0F0F0F0F0F0F0F))
+        | ((b & UINT64_C(0x0F0F0F0F0F0F0F0F)) << 4);
+    return b;
+}
+
+/**
+ * Maps a bitboard through one of the eight symmetries of the board. Bit 2
+ * of "symmetry" transposes the board about the a1-h8 diagonal, then bit 0
+ * mirrors it left to right and bit 1 top to bottom. Each step is a few
+ * delta swaps.
+ */
+uint64_t Board::transform(uint64_t b, int symmetry) {
+    if (symmetry & 4) {
+        b = transpose(b);
+    }
+    if (symmetry & 1) {
+        b = mirror(b);
+    }
+    if (symmetry & 2) {
+        b = __builtin_bswap64(b);
+    }
+    return b;
+}
+
+/**
+ * Replaces the position with "own" to move by its canonical form: of its
+ * eight symmetric images, the one with the smallest (own, opp) pair. Sets
+ * symmetry to the transform giving it, the lowest one if several do, and
+ * returns the canonical position's hash. Images share their transposes and
+ * mirrors, so all eight cost two transposes, four mirrors and eight byte
+ * swaps.
+ */
+uint64_t Board::canonical(uint64_t &own, uint64_t &opp, int &symmetry) {
+    uint64_t own_images[4], opp_images[4];
+    own_images[0] = own;
+    opp_images[0] = opp;
+    own_images[1] = mirror(own);
+    opp_images[1] = mirror(opp);
+    own_images[2] = transpose(own);
+    opp_images[2] = transpose(opp);
+    own_images[3] = mirror(own_images[2]);
+    opp_images[3] = mirror(opp_images[2]);
+
+    uint64_t best_own = own, best_opp = opp;
+    symmetry = 0;
+    for (int s = 1; s < 8; s++) {
+        // Bit 2 picks the transposed images, bit 0 the mirrored ones
+        int image = (s & 1) | ((s & 4) >> 1);
+        uint64_t o = own_images[image], p = opp_images[image];
+        if (s & 2) {
+            o = __builtin_bswap64(o);
+            p = __builtin_bswap64(p);
+        }
+        if (o < best_own || (o == best_own && p < best_opp)) {
+            best_own = o;
+            best_opp = p;
+            symmetry = s;
+        }
+    }
+    own = best_own;
+    opp = best_opp;
+    return hash(own, opp);
+}
+
+/**
+ * Returns the hash of the canonical form of the position with the given
+ * side to move, and sets symmetry to the transform giving it. A move on
+ * this board maps to the canonical one through transformSquare, and back
+ * through untransformSquare.
+ */
+uint64_t Board::canonicalHash(Side side, int &symmetry) const {
+    uint64_t own = (side == BLACK) ? black : white;
+    uint64_t opp = (side == BLACK) ? white : black;
+    return canonical(own, opp, symmetry);
+}
+
+/**
+ * Maps a square through a symmetry, like transform.
+ */
+int Board::transformSquare(int square, int symmetry) {
+    int x = square % 8, y = square / 8;
+    if (symmetry & 4) {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    if (symmetry & 1) {
+        x = 7 - x;
+    }
+    if (symmetry & 2) {
+        y = 7 - y;
+    }
+    return x + 8 * y;
+}
+
+/**
+ * Maps a square back from a symmetry: the inverse of transformSquare.
+ */
+int Board::untransformSquare(int square, int symmetry) {
+    int x = square % 8, y = square / 8;
+    if (symmetry & 2) {
+        y = 7 - y;
+    }
+    if (symmetry & 1) {
+        x = 7 - x;
+    }
+    if (symmetry & 4) {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    return x + 8 * y;
+}
+
+/*
+ * Stable stones of an edge seen on its own, for every pair of 8-bit masks
+ * of own and opposing stones along it, filled in by initStability.
+ */
+static uint8_t edge_stable[256][256];
+static bool stability_initialized = false;
+
+/*
+ * Plays a stone for "own" on square x of a single line and flips what it
+ * outflanks along the line.
+ */
+static void playOnLine(int &own, int &opp, int x) {
+    own |= 1 << x;
+    int y;
+    for (y = x - 1; y >= 0 && (opp & (1 << y)); y--) {
+    }
+    if (y >= 0 && y < x - 1 && (own & (1 << y))) {
+        int flips = ((1 << x) - 1) & ~((2 << y) - 1);
+        own |= flips;
+        opp &= ~flips;
+    }
+    for (y = x + 1; y < 8 && (opp & (1 << y)); y++) {
+    }
+    if (y < 8 && y > x + 1 && (own & (1 << y))) {
+        int flips = ((1 << y) - 1) & ~((2 << x) - 1);
+        own |= flips;
+        opp &= ~flips;
+    }
+}
+
+/*
+ * Narrows "stable" to the own stones of a line that no sequence of stones
+ * played on its empty squares, by either side and legal or not, can flip.
+ */
+static int findEdgeStable(int own, int opp, int stable) {
+    stable &= own;
+    int empty = ~(own | opp) & 0xFF;
+    for (int x = 0; stable && x < 8; x++) {
+        if (empty & (1 << x)) {
+            int p = own, o = opp;
+            playOnLine(p, o, x);
+            stable = findEdgeStable(p, o, stable);
+            p = own;
+            o = opp;
+            playOnLine(o, p, x);
+            stable = findEdgeStable(p, o, stable);
+        }
+    }
+    return stable;
+}
+
+/*
+ * Fills in the edge stability table, the first time a board is made.
+ */
+static void initStability() {
+    if (stability_initialized) {
+        return;
+    }
+    for (int own = 0; own < 256; own++) {
+        for (int opp = 0; opp < 256; opp++) {
+            edge_stable[own][opp] = (own & opp) ? 0
+                : findEdgeStable(own, opp, own);
+        }
+    }
+    stability_initialized = true;
+}
+
+/*
+ * Column x packed into a byte, bottom row in the low bit, and back. The
+ * multiplications move every bit to a different place, so nothing carries.
+ */
+static inline int packColumn(uint64_t b, int x) {
+    return (((b >> x) & UINT64_C(0x0101010101010101))
+            * UINT64_C(0x8040201008040201)) >> 56;
 }
 
+static inline uint64_t unpackColumn(int column, int x) {
+    return (((uint64_t) column * UINT64_C(0x8040201008040201))
+            & UINT64_C(0x8080808080808080)) >> (7 - x);
+}
+
+/*
+ * Squares whose whole line in one direction is filled: the direction's
+ * shift, and the squares with no neighbour going forwards and backwards
+ * along it.
+ */
+static inline uint64_t fullLines(uint64_t filled, int shift,
+        uint64_t forward_end, uint64_t backward_end) {
+    uint64_t forward = filled, backward = filled;
+    for (int i = 0; i < 7; i++) {
+        forward = filled & ((forward >> shift) | forward_end);
+        backward = filled & ((backward << shift) | backward_end);
+    }
+    return forward & backward;
+}
+
+/**
+ * Returns a mask of "own" stones that can never be flipped. Edge stones
+ * can only be flipped along their edge, so their stability comes from a
+ * table of every edge. Any other stone is stable if in each of the four
+ * directions its line is full, or it touches a stable own stone along it:
+ * a line can then never hold the empty square and opposing stone needed
+ * to outflank it. This finds only a subset of the stable stones, which is
+ * all a bound on the final score needs.
+ */
+uint64_t Board::stableDiscs(uint64_t own, uint64_t opp) {
+    const uint64_t top = UINT64_C(0x00000000000000FF);
+    const uint64_t bottom = UINT64_C(0xFF00000000000000);
+    const uint64_t left = UINT64_C(0x0101010101010101);
+    const uint64_t right = UINT64_C(0x8080808080808080);
+    const uint64_t inner = UINT64_C(0x007E7E7E7E7E7E00);
+    const uint64_t corners = UINT64_C(0x8100000000000081);
+    // Until a corner is taken, no edge stone is stable, and it takes full
+    // lines nearly everywhere for any other stone to be
+    if (((own | opp) & corners) == 0) {
+        return 0;
+    }
+    initStability();
+
+    uint64_t stable = (uint64_t) edge_stable[own & 0xFF][opp & 0xFF]
+        | ((uint64_t) edge_stable[own >> 56][opp >> 56] << 56)
+        | unpackColumn(edge_stable[packColumn(own, 0)][packColumn(opp, 0)], 0)
+        | unpackColumn(edge_stable[packColumn(own, 7)][packColumn(opp, 7)], 7);
+
+    uint64_t candidates = own & inner;
+    if (candidates == 0) {
+        return stable;
+    }
+    uint64_t filled = own | opp;
+    uint64_t horizontal = fullLines(filled, 1, right, left);
+    uint64_t vertical = fullLines(filled, 8, bottom, top);
+    uint64_t diagonal = fullLines(filled, 9, right | bottom, left | top);
+    uint64_t antidiagonal = fullLines(filled, 7, left | bottom, right | top);
+    stable |= candidates & horizontal & vertical & diagonal & antidiagonal;
+
+    // Spread from the stable stones found so far until nothing changes
+    uint64_t previous;
+    do {
+        previous = stable;
+        stable |= candidates
+            & (horizontal | (stable << 1) | (stable >> 1))
+            & (vertical | (stable << 8) | (stable >> 8))
+            & (diagonal | (stable << 9) | (stable >> 9))
+            & (antidiagonal | (stable << 7) | (stable >> 7));
+    } while (stable != previous);
+    return stable;
+}
+
+/**
+ * Returns the mask of the given side's stones that can never be flipped.
+ */
+uint64_t Board::stableMask(Side side) const {
+    return (side == BLACK) ? stableDiscs(black, white)
+                           : stableDiscs(white, black);
+}
 
+/**
+ * Returns the number of the given side's stable stones minus its
+ * opponent's.
+ */
+int Board::stability(Side side) const {
+    int difference = bitCount(stableDiscs(black, white))
+        - bitCount(stableDiscs(white, black));
+    return (side == BLACK) ? difference : -difference;
+}
 
 /**
 Updates the board to reflect the specified move. Assumes the move is valid.
@@ -94,99 +517,41 @@ void Board::doMove(Move *m, Side side) {
     // A NULL move means pass.
     if (m == NULL) return;
 
-    int X = m->getX();
-    int Y = m->getY();
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            int x = X;
-            int y = Y;
-            do {
-                x += dx;
-                y += dy;
-            } while (onBoard(x, y) && get(other, x, y));
-
-            if (onBoard(x, y) && get(side, x, y)) {
-                x = X;
-                y = Y;
-                x += dx;
-                y += dy;
-                while (onBoard(x, y) && get(other, x, y)) {
-                    set(side, x, y);
-                    x += dx;
-                    y += dy;
-                }
-            }
-        }
-    }
-    set(side, X, Y);
+    doMove(m->getX() + 8 * m->getY(), side);
 }
 
 /**
-If the move is legal, returns a new Board where the move has been made.
-The returned Board is dynamically allocated; please free with delete.
-If the move is NOT legal, returns NULL.
-Assumes the move is non-NULL.
+Updates the board to reflect a move on the given square (x + 8 * y).
+Assumes the move is valid.
 */
-Board *Board::doMoveIfLegal(Move *m, Side side) {
-    int X = m->getX();
-    int Y = m->getY();
-
-    // Make sure the square hasn't already been taken.
-    if (occupied(X, Y)) return NULL;
-
-    Board *newBoard = NULL;
-
-    Side other = (side == BLACK) ? WHITE : BLACK;
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dy = -1; dy <= 1; dy++) {
-            if (dy == 0 && dx == 0) continue;
-
-            // Is there a capture in that direction?
-            int x = X + dx;
-            int y = Y + dy;
-            if (onBoard(x, y) && get(other, x, y)) {
-                do {
-                    x += dx;
-                    y += dy;
-                } while (onBoard(x, y) && get(other, x, y));
-
-                if (onBoard(x, y) && get(side, x, y)) {
-                    // This is a legal move
-
-                    if (newBoard == NULL) {
-                        // Initialize newBoard if it hasn't been yet.
-                        newBoard = this->copy();
-                        // err << "In doMoveIfLegal: Legal move (x, y) (" << X << ", " << Y << ")" << endl;
-                    }
-
-                    /*
-                    Flip all pieces between (x, y), and (m.x, m.y).
-                    */
-                    for (int i = X + dx, j = Y + dy;
-                         i != x || j != y;
-                         i += dx, j += dy) {
-                        newBoard->flip(i, j);
-                        // cerr << "Flip (i, j) " << i << " " << j << endl;
-                    }
-                }
+void Board::doMove(int square, Side side) {
+    uint64_t flips = (side == BLACK) ? flipMask(black, white, square)
+                                     : flipMask(white, black, square);
+    black ^= flips;
+    white ^= flips;
+    set(side, square % 8, square / 8);
+
+    // The new stone adds its digit (1 black, 2 white) to every instance of
+    // its square, and a flip moves a digit between 1 and 2.
+    const Patterns::Feature *f;
+    int digit = (side == BLACK) ? 1 : 2;
+    for (f = Patterns::features[square]; f->instance != Patterns::INSTANCES;
+            f++) {
+        patterns[f->instance] += digit * f->power;
+    }
+    while (flips) {
+        f = Patterns::features[firstSquare(flips)];
+        if (side == BLACK) {
+            for (; f->instance != Patterns::INSTANCES; f++) {
+                patterns[f->instance] -= f->power;
+            }
+        } else {
+            for (; f->instance != Patterns::INSTANCES; f++) {
+                patterns[f->instance] += f->power;
             }
         }
+        flips &= flips - 1;
     }
-
-    if (newBoard != NULL) {
-        // Add new piece at (m.x, m.y)
-        newBoard->set(side, X, Y);
-
-        // cerr << "Resulting board:" << endl;
-        // newBoard->printboard();
-    } else {
-        // cerr << "In doMoveIfLegal: Illegal move (x, y) (" << X << ", " << Y << ")" << endl;
-    }
-
-    return newBoard;
 }
 
 /**
@@ -194,58 +559,60 @@ Calculates the score, from the perspective of the specified side.
 (Squares occupied by the same side as "side" contribute positively;
 those occupied by the opposite side contribute negatively.)
 */
-int Board::score(Side side) {
-    return heuristic_value(side) + 0.2 * mobility(side);
+int Board::score(Side side) const {
+    return score(side, moveMask(side));
+}
+
+/**
+Same as score(side), for a caller that already has the side's legal moves,
+and optionally with other evaluation weights.
+*/
+int Board::score(Side side, uint64_t moves,
+        const Patterns::WeightSet &set) const {
+    int discs = countAll();
+    double value = heuristic_value(side, set)
+        + Patterns::mobilityTerm(mobility(side, moves), discs, set);
+    // Stability is costly to find, so only when it is weighted
+    if (set.stability[Patterns::stage(discs)] != 0) {
+        value += Patterns::stabilityTerm(stability(side), discs, set);
+    }
+    return value;
 }
 
 /**
  * Simply finds the stone differential, used in the endgame
  * board position score = (# stones you have) - (# stones your opponent has)
  */ 
-int Board::score_endgame(Side side) {
-	int output = 0;
-    for (int i = 0; i < 64; i++) {
-        if (taken[i]) {
-            if (black[i] == (side == BLACK)) {
-                /*
-                if it's occupied by black and you are BLACK or
-                if it's occupied by white and you are WHITE
-                */
-                output += 1;
-            } else {
-                output -= 1;
-            }
-        }
-    }
-    return output;
+int Board::score_endgame(Side side) const {
+    return count(side) - count(side == BLACK ? WHITE : BLACK);
 }
 
 /**
  * Count total number of stones in the board
  */
-int Board::countAll() {
-    return taken.count();
+int Board::countAll() const {
+    return bitCount(black | white);
 }
 
 /**
  * Current count of given side's stones.
  */
-int Board::count(Side side) {
+int Board::count(Side side) const {
     return (side == BLACK) ? countBlack() : countWhite();
 }
 
 /**
  * Current count of black stones.
  */
-int Board::countBlack() {
-    return black.count();
+int Board::countBlack() const {
+    return bitCount(black);
 }
 
 /**
  * Current count of white stones.
  */
-int Board::countWhite() {
-    return taken.count() - black.count();
+int Board::countWhite() const {
+    return bitCount(white);
 }
 
 /**
@@ -253,16 +620,25 @@ int Board::countWhite() {
  * piece and 'b' indicates a black piece. Mainly for testing purposes.
  */
 void Board::setBoard(char data[]) {
-    taken.reset();
-    black.reset();
+    black = 0;
+    white = 0;
     for (int i = 0; i < 64; i++) {
         if (data[i] == 'b') {
-            taken.set(i);
-            black.set(i);
+            black |= squareBit(i);
         } if (data[i] == 'w') {
-            taken.set(i);
+            white |= squareBit(i);
         }
     }
+    Patterns::index(black, white, patterns);
+}
+
+/**
+ * Sets the board state to the given stones.
+ */
+void Board::setBoard(uint64_t black, uint64_t white) {
+    this->black = black;
+    this->white = white;
+    Patterns::index(black, white, patterns);
 }
 
 /**
@@ -271,7 +647,7 @@ void Board::setBoard(char data[]) {
  * BLACK-B
  * WHITE-W
  */
-void Board::printboard()
+void Board::printboard() const
 {
 	for (int j = 0; j < 8; j++) {
         for (int i = 0; i < 8; i++) {
@@ -296,62 +672,41 @@ void Board::printboard()
 /**
  * Returns true if a move is legal for the given side; false otherwise.
  */
-bool Board::checkMove(Move *m, Side side) {
+bool Board::checkMove(Move *m, Side side) const {
 	int X = m->getX();
 	int Y = m->getY();
 	// Make sure the square hasn't already been taken.
 	if (occupied(X, Y)) return false;
-	Side other = (side == BLACK) ? WHITE : BLACK;
-	for (int dx = -1; dx <= 1; dx++) {
-		for (int dy = -1; dy <= 1; dy++) {
-			if (dy == 0 && dx == 0) continue;
-			// Is there a capture in that direction?
-			int x = X + dx;
-			int y = Y + dy;
-			if (onBoard(x, y) && get(other, x, y)) {
-				do {
-					x += dx;
-					y += dy;
-				} while (onBoard(x, y) && get(other, x, y));
-				if (onBoard(x, y) && get(side, x, y)) return true;
-			}
-		}
-	}
-	return false;
+	return (side == BLACK) ? flipMask(black, white, X + 8 * Y) != 0
+	                       : flipMask(white, black, X + 8 * Y) != 0;
 }
 
 /**
  * return the number of valid moves
  */
-int Board::valid_move(Side side)
+int Board::valid_move(Side side) const
 {
-	int count = 0;
-	Move * new_move;
-	for (int i = 0; i < 8; i++)
-	{
-		for (int j = 0; j < 8; j++)
-		{
-			new_move = new Move(i, j);
-			if (checkMove(new_move, side))
-			{
-				count += 1;
-			}
-            delete new_move; 
-		}
-	}
-	return count;
+	return bitCount(moveMask(side));
 }
 
 /**
  * return the heuristic variable: mobility
  */ 
-double Board::mobility(Side side)
+double Board::mobility(Side side) const
+{
+	return mobility(side, moveMask(side));
+}
+
+/**
+ * Same as mobility(side), given the side's legal moves.
+ */
+double Board::mobility(Side side, uint64_t moves) const
 {
 	double mobility;
 	Side other = (side == BLACK) ? WHITE : BLACK;
     if (count(side) == 0) return -100;
     if (count(other) == 0) return 100;
-	int my_stone = valid_move(side);
+	int my_stone = bitCount(moves);
 	int opp_stone = valid_move(other);
 	if (my_stone > opp_stone)
 	{
@@ -368,21 +723,38 @@ double Board::mobility(Side side)
 	return mobility;
 }
 
-int Board::heuristic_value(Side side)
+/**
+ * Potential mobility: the number of empty squares next to an opponent
+ * stone, where the side might get moves later.
+ */
+int Board::potentialMobility(Side side) const
 {
-	int heuristic_value = 0;
-    for (int i = 0; i < 64; i++) {
-        if (taken[i]) {
-            if (black[i] == (side == BLACK)) {
-                /*
-                if it's occupied by black and you are BLACK or
-                if it's occupied by white and you are WHITE
-                */
-                heuristic_value += heuristic_values[i];
-            } else {
-                heuristic_value -= heuristic_values[i];
-            }
-        }
-    }
-    return heuristic_value;
+    uint64_t opp = pieces(side == BLACK ? WHITE : BLACK);
+    return bitCount(neighbours(opp) & empties());
+}
+
+/**
+ * Frontier: the number of the side's stones next to an empty square. These
+ * give the opponent moves, so fewer is better.
+ */
+int Board::frontier(Side side) const
+{
+    return bitCount(pieces(side) & neighbours(empties()));
+}
+
+/**
+ * Returns the pattern evaluation of the board from the perspective of the
+ * given side, with the given weights. The pattern indices are kept up to
+ * date as moves are made; with CHECK_INCREMENTAL defined, they are checked
+ * against a full recount.
+ */
+int Board::heuristic_value(Side side, const Patterns::WeightSet &set) const
+{
+#ifdef CHECK_INCREMENTAL
+    uint16_t recount[Patterns::INSTANCES];
+    Patterns::index(black, white, recount);
+    assert(!memcmp(recount, patterns, sizeof(recount)));
+#endif
+    int value = Patterns::evaluate(patterns, countAll(), set);
+    return (side == BLACK) ? value : -value;
 }
@@ -1,43 +1,86 @@
 #ifndef __BOARD_H__
 #define __BOARD_H__
 
-#include <bitset>
+#include <stdint.h>
 #include "common.h"
+#include "pattern.h"
 using namespace std;
 
+/*
+ * Bitboard helpers. Square (x, y) is bit x + 8 * y.
+ */
+inline int bitCount(uint64_t b) {
+    return __builtin_popcountll(b);
+}
+
+/*
+ * Index of the lowest set bit; b must be non-zero.
+ */
+inline int firstSquare(uint64_t b) {
+    return __builtin_ctzll(b);
+}
+
+inline uint64_t squareBit(int square) {
+    return (uint64_t) 1 << square;
+}
+
 class Board {
-   
+
 private:
-    bitset<64> black;
-    bitset<64> taken;    
-       
-    bool occupied(int x, int y);
-    bool get(Side side, int x, int y);
+    uint64_t black;
+    uint64_t white;
+    // Index of every pattern instance, updated incrementally by doMove
+    uint16_t patterns[Patterns::INSTANCES];
+
+    bool occupied(int x, int y) const;
+    bool get(Side side, int x, int y) const;
     void set(Side side, int x, int y);
-    void flip(int x, int y);
-    bool onBoard(int x, int y);
-      
+
 public:
     Board();
     ~Board();
-    Board *copy();
-    
+
     static const int heuristic_values[64];
-    
-    bool checkMove(Move *m, Side side);
+
+    static uint64_t legalMoves(uint64_t own, uint64_t opp);
+    static uint64_t flipMask(uint64_t own, uint64_t opp, int square);
+    static uint64_t neighbours(uint64_t squares);
+    static uint64_t stableDiscs(uint64_t own, uint64_t opp);
+    static uint64_t hash(uint64_t own, uint64_t opp);
+    static uint64_t transform(uint64_t b, int symmetry);
+    static uint64_t canonical(uint64_t &own, uint64_t &opp, int &symmetry);
+    static int transformSquare(int square, int symmetry);
+    static int untransformSquare(int square, int symmetry);
+
+    uint64_t pieces(Side side) const;
+    uint64_t empties() const;
+    uint64_t moveMask(Side side) const;
+    uint64_t stableMask(Side side) const;
+    uint64_t hash(Side side) const;
+    uint64_t canonicalHash(Side side, int &symmetry) const;
+
+    bool checkMove(Move *m, Side side) const;
     void doMove(Move *m, Side side);
-    Board *doMoveIfLegal(Move *m, Side side);
-    int score(Side side);
-    int score_endgame(Side side);
-    int countAll();
-    int count(Side side);
-    int countBlack();
-    int countWhite();
+    void doMove(int square, Side side);
+    int score(Side side) const;
+    int score(Side side, uint64_t moves,
+            const Patterns::WeightSet &set = Patterns::standard) const;
+    int score_endgame(Side side) const;
+    int countAll() const;
+    int count(Side side) const;
+    int countBlack() const;
+    int countWhite() const;
     void setBoard(char data[]);
-    void printboard();
-    int valid_move(Side side);
-    double mobility(Side side);
-    int heuristic_value(Side side);
+    void setBoard(uint64_t black, uint64_t white);
+    void printboard() const;
+    int valid_move(Side side) const;
+    double mobility(Side side) const;
+    double mobility(Side side, uint64_t moves) const;
+    int potentialMobility(Side side) const;
+    int frontier(Side side) const;
+    int stability(Side side) const;
+    int heuristic_value(Side side,
+            const Patterns::WeightSet &set = Patterns::standard) const;
 };
 
 #endif
@@ -0,0 +1,145 @@
+#include "book.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char *const OpeningBook::BOOK_FILE = "book.bin";
+
+/*
+ * A book file starts with this and the number of entries as a 64-bit
+ * integer, in the machine's byte order; the entries follow. Books keyed
+ * by the older minimum-hash key had "NoobBook" and are refused.
+ */
+static const char BOOK_MAGIC[8] = {'N', 'o', 'o', 'b', 'B', 'o', 'k', '2'};
+static const size_t HEADER_BYTES = 16;
+
+/**
+ * Makes an empty book.
+ */
+OpeningBook::OpeningBook() {
+    mapping = NULL;
+    mapping_size = 0;
+    entries = NULL;
+    count = 0;
+}
+
+/**
+ * Destructor for the book.
+ */
+OpeningBook::~OpeningBook() {
+    close();
+}
+
+/**
+ * Maps a book file into memory, replacing any book already open. Returns
+ * false, leaving the book empty, if the file is missing or not a book.
+ */
+bool OpeningBook::open(const char *filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t) info.st_size < HEADER_BYTES) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    uint64_t stored;
+    memcpy(&stored, (const char *) data + 8, sizeof(stored));
+    if (memcmp(data, BOOK_MAGIC, sizeof(BOOK_MAGIC))
+            || HEADER_BYTES + stored * sizeof(BookEntry)
+                != (size_t) info.st_size) {
+        munmap(data, info.st_size);
+        return false;
+    }
+    mapping = data;
+    mapping_size = info.st_size;
+    entries = (const BookEntry *) ((const char *) data + HEADER_BYTES);
+    count = stored;
+    return true;
+}
+
+/**
+ * Unmaps the book file, if any.
+ */
+void OpeningBook::close() {
+    if (mapping != NULL) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = NULL;
+    mapping_size = 0;
+    entries = NULL;
+    count = 0;
+}
+
+/**
+ * Returns the number of positions in the book.
+ */
+size_t OpeningBook::size() const {
+    return count;
+}
+
+/**
+ * Looks up the position with the given side to move. Returns true, and sets
+ * square to the book move and score to its score, if it is in the book.
+ */
+bool OpeningBook::lookup(const Board &board, Side side, int &square,
+        int &score) const {
+    if (count == 0) {
+        return false;
+    }
+    int symmetry;
+    uint64_t k = board.canonicalHash(side, symmetry);
+
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (entries[middle].key < k) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == count || entries[low].key != k) {
+        return false;
+    }
+
+    square = Board::untransformSquare(entries[low].move, symmetry);
+    score = entries[low].score;
+    // A hash collision could give a move that is not even legal here
+    return (board.moveMask(side) & squareBit(square)) != 0;
+}
+
+static bool entryBefore(const BookEntry &a, const BookEntry &b) {
+    return a.key < b.key;
+}
+
+/**
+ * Sorts entries by key and writes them to a book file. Returns false if the
+ * file cannot be written.
+ */
+bool OpeningBook::write(const char *filename,
+        std::vector<BookEntry> &entries) {
+    std::sort(entries.begin(), entries.end(), entryBefore);
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    uint64_t stored = entries.size();
+    bool ok = fwrite(BOOK_MAGIC, sizeof(BOOK_MAGIC), 1, file) == 1
+        && fwrite(&stored, sizeof(stored), 1, file) == 1
+        && (entries.empty() || fwrite(&entries[0], sizeof(BookEntry),
+                entries.size(), file) == entries.size());
+    return fclose(file) == 0 && ok;
+}
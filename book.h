@@ -0,0 +1,59 @@
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "board.h"
+
+/*
+ * A book position: the best move found for it and its score, from the
+ * point of view of the side to move. The key is the hash of the position's
+ * canonical form (see Board::canonical), and the move is on that form.
+ */
+struct BookEntry {
+    uint64_t key;
+    int16_t score;
+    int8_t move;
+    int8_t depth;
+    uint8_t reserved[4];
+};
+
+/*
+ * Opening book read from a file made by the makebook tool. The file is a
+ * header followed by entries sorted by key; it is memory-mapped, and
+ * lookups binary-search it.
+ *
+ * Positions are keyed by their canonical form over the eight symmetries of
+ * the board, so each line of play is stored once however it is rotated or
+ * mirrored.
+ */
+class OpeningBook {
+
+private:
+    void *mapping;
+    size_t mapping_size;
+    const BookEntry *entries;
+    size_t count;
+
+public:
+    // Default book file
+    static const char *const BOOK_FILE;
+
+    OpeningBook();
+    ~OpeningBook();
+
+    bool open(const char *filename);
+    void close();
+    size_t size() const;
+
+    bool lookup(const Board &board, Side side, int &square, int &score) const;
+
+    static bool write(const char *filename, std::vector<BookEntry> &entries);
+
+private:
+    OpeningBook(const OpeningBook &);
+    OpeningBook &operator=(const OpeningBook &);
+};
+
+#endif
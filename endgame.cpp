@@ -0,0 +1,521 @@
+#include "player.h"
+
+/*
+ * Exact endgame solver. Positions are searched as a pair of bitboards, the
+ * stones of the side to move and of its opponent, and moves are made and
+ * unmade in place. Empty squares are kept in a linked list so finding the
+ * moves near the end of the game does not scan all 64 squares, and the last
+ * few empties are solved by dedicated routines.
+ */
+
+/*
+ * Order in which empty squares are put in the list, and so tried when no
+ * better ordering is known: corners first, then edges, the center, and
+ * the squares next to corners last.
+ */
+static const int SQUARE_ORDER[64] = {
+     0,  7, 56, 63,
+     2,  5, 16, 23, 40, 47, 58, 61,
+     3,  4, 24, 31, 32, 39, 59, 60,
+    18, 21, 42, 45,
+    19, 20, 26, 29, 34, 37, 43, 44,
+    27, 28, 35, 36,
+    10, 11, 12, 13, 17, 22, 25, 30, 33, 38, 41, 46, 50, 51, 52, 53,
+     1,  6,  8, 15, 48, 55, 57, 62,
+     9, 14, 49, 54
+};
+
+/*
+ * Bit of the quadrant each square is in, for tracking the parity of the
+ * number of empty squares per quadrant.
+ */
+static inline int quadrant(int square) {
+    return 1 << ((square % 8 >= 4) + 2 * (square / 8 >= 4));
+}
+
+/*
+ * Stone differential from the point of view of the side with stones P when
+ * the game is over.
+ */
+static inline int finalScore(uint64_t P, uint64_t O) {
+    return bitCount(P) - bitCount(O);
+}
+
+/**
+Returns the exact final stone differential of the board with perfect play,
+and sets best_move to the square (x + 8 * y) of the move that will reach
+that score. Searches to the end of the game, where the to-be-optimized
+player is on the specified side. Uses the transposition table like minimax,
+under keys of its own so disc differentials never mix with heuristic scores.
+
+If the game is over, or the side to move has to pass, best_move is NO_MOVE.
+Like minimax, returns early with a meaningless score once the clock set by
+startClock runs out.
+*/
+int Player::minimax_endgame(const Board &board, Side side, int lower_bound,
+        int upper_bound, int &best_move) {
+    Side otherSide = side == BLACK ? WHITE : BLACK;
+    uint64_t P = board.pieces(side);
+    uint64_t O = board.pieces(otherSide);
+
+    // Build the list of empty squares, with the head at index 64
+    int last = 64;
+    parity = 0;
+    for (int i = 0; i < 64; i++) {
+        int square = SQUARE_ORDER[i];
+        if (!((P | O) & squareBit(square))) {
+            empty_next[last] = square;
+            empty_prev[square] = last;
+            last = square;
+            parity ^= quadrant(square);
+        }
+    }
+    empty_next[last] = 64;
+    empty_prev[64] = last;
+
+    int empties = 64 - board.countAll();
+    if (upper_bound - lower_bound == 1) {
+        return solve<NULL_WINDOW_NODE>(P, O, lower_bound, upper_bound,
+                empties, false, best_move);
+    }
+    return solve<PV_NODE>(P, O, lower_bound, upper_bound, empties, false,
+            best_move);
+}
+
+/**
+Solves the position with P to move and the given number of empty squares,
+which must be the ones in the empty list. Returns the score for P, and sets
+best_move, like minimax_endgame. "passed" tells whether the opponent just
+passed, in which case the game is over if P cannot move either.
+
+Positions are looked up in and stored to the transposition table, and moves
+are ordered with fewest replies first, while at least ORDER_EMPTIES squares
+are empty. Closer to the end, moves are simply tried in list order, those
+in quadrants with an odd number of empties first, and the last
+LAST_EMPTIES squares are handed to solve4 and below.
+
+Like search, it is compiled once for PV_NODE and once for NULL_WINDOW_NODE.
+*/
+template <Player::NodeType NODE>
+int Player::solve(uint64_t P, uint64_t O, int alpha, int beta, int empties,
+        bool passed, int &best_move) {
+    best_move = NO_MOVE;
+    if (outOfTime()) {
+        return 0;
+    }
+
+    uint64_t moves = Board::legalMoves(P, O);
+    if (moves == 0) {
+        int garbage;
+        if (passed) {
+            return finalScore(P, O);
+        }
+        return -solve<NODE>(O, P, -beta, -alpha, empties, true, garbage);
+    }
+
+    // Stability cutoff: the opponent keeps its stable stones whatever
+    // happens, which caps our final score. It cannot have more stable
+    // stones than stones, so most nodes skip looking.
+    if (alpha >= STABILITY_MIN_ALPHA && alpha >= 64 - 2 * bitCount(O)) {
+        int ceiling = 64 - 2 * bitCount(Board::stableDiscs(O, P));
+        if (ceiling <= alpha) {
+            return ceiling;
+        }
+    }
+
+    uint64_t key = 0;
+    int hash_move = NO_MOVE;
+    int best_score = -1000000;
+    int original_alpha = alpha;
+    if (empties >= ORDER_EMPTIES) {
+        key = Board::hash(P, O) ^ ENDGAME_KEY;
+        hash_move = probe(key, moves, empties, alpha, beta, best_score);
+        if (best_score != -1000000) {
+            best_move = hash_move;
+            return best_score;
+        }
+        // Positions solved in earlier games are exact whatever the window
+        if (lookupSolved(P, O, empties, best_move, best_score)) {
+            return best_score;
+        }
+    }
+
+    int move_list[MAX_MOVES];
+    int move_count = orderEndgameMoves(P, O, moves, hash_move, empties,
+            move_list);
+    for (int i = 0; i < move_count; i++) {
+        int square = move_list[i];
+        uint64_t flips = Board::flipMask(P, O, square);
+        uint64_t new_P = P | flips | squareBit(square);
+        uint64_t new_O = O & ~flips;
+        int new_score;
+
+        if (empties - 1 <= LAST_EMPTIES) {
+            new_score = -solveLast(new_O, new_P, -beta, -alpha, square);
+        } else {
+            // Take the square off the empty list while searching below it
+            int garbage;
+            empty_next[empty_prev[square]] = empty_next[square];
+            empty_prev[empty_next[square]] = empty_prev[square];
+            parity ^= quadrant(square);
+
+            // Principal variation search, as in minimax
+            if (NODE == NULL_WINDOW_NODE) {
+                new_score = -solve<NULL_WINDOW_NODE>(new_O, new_P, -beta,
+                        -alpha, empties - 1, false, garbage);
+            } else if (i == 0) {
+                new_score = -solve<PV_NODE>(new_O, new_P, -beta, -alpha,
+                        empties - 1, false, garbage);
+            } else {
+                new_score = -solve<NULL_WINDOW_NODE>(new_O, new_P,
+                        -alpha - 1, -alpha, empties - 1, false, garbage);
+                if (new_score > alpha && new_score < beta && !stopped) {
+                    new_score = -solve<PV_NODE>(new_O, new_P, -beta, -alpha,
+                            empties - 1, false, garbage);
+                }
+            }
+
+            parity ^= quadrant(square);
+            empty_next[empty_prev[square]] = square;
+            empty_prev[empty_next[square]] = square;
+        }
+        if (stopped) {
+            return 0;
+        }
+
+        if (new_score > best_score) {
+            best_score = new_score;
+            best_move = square;
+        }
+        if (new_score > alpha) {
+            alpha = new_score;
+        }
+        if (alpha >= beta) {
+            stats.cutoffs++;
+            if (i == 0) {
+                stats.first_move_cutoffs++;
+            }
+            break;
+        }
+    }
+
+    if (empties >= ORDER_EMPTIES) {
+        store(key, empties, original_alpha, beta, best_score, best_move);
+    }
+    return best_score;
+}
+
+/**
+Fills move_list with the given legal moves of P, best candidates first, and
+returns how many there are. With at least ORDER_EMPTIES empty squares, the
+hash move comes first and the rest are sorted by how few replies they leave
+the opponent, then by quadrant parity. Otherwise moves in quadrants with an
+odd number of empty squares come first, each group in empty list order.
+*/
+int Player::orderEndgameMoves(uint64_t P, uint64_t O, uint64_t moves,
+        int hash_move, int empties, int move_list[]) {
+    int count = 0;
+    if (empties < ORDER_EMPTIES) {
+        for (int odd = 1; odd >= 0; odd--) {
+            for (int square = empty_next[64]; square != 64;
+                    square = empty_next[square]) {
+                if ((moves & squareBit(square))
+                        && ((parity & quadrant(square)) != 0) == odd) {
+                    move_list[count++] = square;
+                }
+            }
+        }
+        stats.moves_generated += count;
+        return count;
+    }
+
+    int keys[MAX_MOVES];
+    for (int square = empty_next[64]; square != 64;
+            square = empty_next[square]) {
+        if (!(moves & squareBit(square))) {
+            continue;
+        }
+
+        int key;
+        if (square == hash_move) {
+            key = 1 << 30;
+        } else {
+            uint64_t flips = Board::flipMask(P, O, square);
+            uint64_t replies = Board::legalMoves(O & ~flips,
+                    P | flips | squareBit(square));
+            key = -bitCount(replies) * MOBILITY_ORDER_WEIGHT;
+            if (parity & quadrant(square)) {
+                key += PARITY_ORDER_WEIGHT;
+            }
+        }
+
+        // Insertion sort, best key first; ties keep list order
+        int i = count++;
+        while (i > 0 && keys[i - 1] < key) {
+            keys[i] = keys[i - 1];
+            move_list[i] = move_list[i - 1];
+            i--;
+        }
+        keys[i] = key;
+        move_list[i] = square;
+    }
+    stats.moves_generated += count;
+    return count;
+}
+
+/**
+Solves a position with at most LAST_EMPTIES empty squares: the ones left in
+the empty list besides "played", which was just taken by the opponent of P
+but is still in the list. Puts the squares in quadrants with an odd number
+of empties first and hands them to the solver for that many.
+*/
+int Player::solveLast(uint64_t P, uint64_t O, int alpha, int beta,
+        int played) {
+    int x[LAST_EMPTIES];
+    int count = 0;
+    int last_parity = parity ^ quadrant(played);
+    for (int odd = 1; odd >= 0; odd--) {
+        for (int square = empty_next[64]; square != 64;
+                square = empty_next[square]) {
+            if (square != played
+                    && ((last_parity & quadrant(square)) != 0) == odd) {
+                x[count++] = square;
+            }
+        }
+    }
+
+    switch (count) {
+    case 4:
+        return solve4(P, O, alpha, beta, x[0], x[1], x[2], x[3], false);
+    case 3:
+        return solve3(P, O, alpha, beta, x[0], x[1], x[2], false);
+    case 2:
+        return solve2(P, O, alpha, beta, x[0], x[1], false);
+    case 1:
+        return solve1(P, O, x[0]);
+    default:
+        return finalScore(P, O);
+    }
+}
+
+/**
+Solves a position with the four given empty squares, in the order given.
+Returns the score for P; "passed" is as for solve.
+*/
+int Player::solve4(uint64_t P, uint64_t O, int alpha, int beta, int x1,
+        int x2, int x3, int x4, bool passed) {
+    stats.nodes++;
+    int best_score = -1000000;
+    int score;
+    uint64_t flips;
+
+    if ((flips = Board::flipMask(P, O, x1))) {
+        score = -solve3(O & ~flips, P | flips | squareBit(x1), -beta, -alpha,
+                x2, x3, x4, false);
+        if (score >= beta) return score;
+        if (score > best_score) best_score = score;
+        if (score > alpha) alpha = score;
+    }
+    if ((flips = Board::flipMask(P, O, x2))) {
+        score = -solve3(O & ~flips, P | flips | squareBit(x2), -beta, -alpha,
+                x1, x3, x4, false);
+        if (score >= beta) return score;
+        if (score > best_score) best_score = score;
+        if (score > alpha) alpha = score;
+    }
+    if ((flips = Board::flipMask(P, O, x3))) {
+        score = -solve3(O & ~flips, P | flips | squareBit(x3), -beta, -alpha,
+                x1, x2, x4, false);
+        if (score >= beta) return score;
+        if (score > best_score) best_score = score;
+        if (score > alpha) alpha = score;
+    }
+    if ((flips = Board::flipMask(P, O, x4))) {
+        score = -solve3(O & ~flips, P | flips | squareBit(x4), -beta, -alpha,
+                x1, x2, x3, false);
+        if (score > best_score) best_score = score;
+    }
+
+    if (best_score == -1000000) {
+        // No move: pass, or the game is over
+        if (passed) {
+            return finalScore(P, O);
+        }
+        return -solve4(O, P, -beta, -alpha, x1, x2, x3, x4, true);
+    }
+    return best_score;
+}
+
+/**
+Solves a position with the three given empty squares, like solve4.
+*/
+int Player::solve3(uint64_t P, uint64_t O, int alpha, int beta, int x1,
+        int x2, int x3, bool passed) {
+    stats.nodes++;
+    int best_score = -1000000;
+    int score;
+    uint64_t flips;
+
+    if ((flips = Board::flipMask(P, O, x1))) {
+        score = -solve2(O & ~flips, P | flips | squareBit(x1), -beta, -alpha,
+                x2, x3, false);
+        if (score >= beta) return score;
+        if (score > best_score) best_score = score;
+        if (score > alpha) alpha = score;
+    }
+    if ((flips = Board::flipMask(P, O, x2))) {
+        score = -solve2(O & ~flips, P | flips | squareBit(x2), -beta, -alpha,
+                x1, x3, false);
+        if (score >= beta) return score;
+        if (score > best_score) best_score = score;
+        if (score > alpha) alpha = score;
+    }
+    if ((flips = Board::flipMask(P, O, x3))) {
+        score = -solve2(O & ~flips, P | flips | squareBit(x3), -beta, -alpha,
+                x1, x2, false);
+        if (score > best_score) best_score = score;
+    }
+
+    if (best_score == -1000000) {
+        if (passed) {
+            return finalScore(P, O);
+        }
+        return -solve3(O, P, -beta, -alpha, x1, x2, x3, true);
+    }
+    return best_score;
+}
+
+/**
+Solves a position with the two given empty squares, like solve4.
+*/
+int Player::solve2(uint64_t P, uint64_t O, int alpha, int beta, int x1,
+        int x2, bool passed) {
+    stats.nodes++;
+    int best_score = -1000000;
+    int score;
+    uint64_t flips;
+
+    if ((flips = Board::flipMask(P, O, x1))) {
+        score = -solve1(O & ~flips, P | flips | squareBit(x1), x2);
+        if (score >= beta) return score;
+        best_score = score;
+    }
+    if ((flips = Board::flipMask(P, O, x2))) {
+        score = -solve1(O & ~flips, P | flips | squareBit(x2), x1);
+        if (score > best_score) best_score = score;
+    }
+
+    if (best_score == -1000000) {
+        if (passed) {
+            return finalScore(P, O);
+        }
+        return -solve2(O, P, -beta, -alpha, x1, x2, true);
+    }
+    return best_score;
+}
+
+/**
+Returns the final score for P of a position with one empty square, x:
+P plays there if it can, otherwise the opponent does if it can.
+*/
+int Player::solve1(uint64_t P, uint64_t O, int x) {
+    stats.nodes++;
+    int score = finalScore(P, O);
+    uint64_t flips = Board::flipMask(P, O, x);
+    if (flips) {
+        return score + 2 * bitCount(flips) + 1;
+    }
+    flips = Board::flipMask(O, P, x);
+    if (flips) {
+        return score - 2 * bitCount(flips) - 1;
+    }
+    return score;
+}
+
+/**
+Solves the board and returns the best move, or NO_MOVE if the solve was
+stopped before even the win/loss/draw result was known. A null window
+search around a draw comes first, which settles whether the game is won,
+lost or drawn much faster than the exact score; its move is played if the
+exact solve does not finish. The exact solve then uses an aspiration
+window centered on the score stored for the position by an earlier solve,
+which is usually exact after a move we saw coming, or else on the first
+result. The score, or just its sign if only that is known, goes in stats.
+*/
+int Player::solveEndgame(const Board &board) {
+    Side other = (root_side == BLACK) ? WHITE : BLACK;
+    uint64_t own = board.pieces(root_side), opp = board.pieces(other);
+    int empties = 64 - board.countAll();
+    int cached_move, cached_score;
+    if (lookupSolved(own, opp, empties, cached_move, cached_score)
+            && (board.moveMask(root_side) & squareBit(cached_move))) {
+        stats.score = cached_score;
+        stats.exact = true;
+        stats.depth = empties;
+        return cached_move;
+    }
+
+    TTEntry earlier;
+    bool have_earlier = tt->probe(board.hash(root_side) ^ ENDGAME_KEY,
+            earlier);
+
+    int wld_move;
+    int wld = minimax_endgame(board, root_side, -1, 1, wld_move);
+    if (stopped) {
+        return NO_MOVE;
+    }
+    stats.score = wld;
+    stats.exact = (wld == 0);
+    stats.depth = (wld == 0) ? empties : 0;
+    if (wld == 0) {
+        saveSolved(own, opp, empties, wld_move, 0);
+        return wld_move;
+    }
+
+    int guess = wld;
+    if (have_earlier && (earlier.score > 0) == (wld > 0)) {
+        guess = earlier.score;
+    }
+
+    int best_move;
+    int score = aspirationSearch(board, ENDGAME, guess, ENDGAME_WINDOW,
+            best_move);
+    if (stopped) {
+        return wld_move;
+    }
+    stats.score = score;
+    stats.exact = true;
+    stats.depth = empties;
+    saveSolved(own, opp, empties, best_move, score);
+    return best_move;
+}
+
+/**
+Looks up a position with P to move and the given number of empty squares
+in the solved position cache, if it is one the cache keeps. Returns true,
+and sets best_move and score to its best move and exact score, if found.
+*/
+bool Player::lookupSolved(uint64_t P, uint64_t O, int empties,
+        int &best_move, int &score) {
+    if (solved == NULL || empties < SolvedCache::MIN_EMPTIES
+            || empties > SolvedCache::MAX_EMPTIES
+            || !solved->lookup(P, O, best_move, score)) {
+        return false;
+    }
+    stats.solved_hits++;
+    return true;
+}
+
+/**
+Adds the exact solve of a position with P to move to the solved position
+cache, if there is one and it keeps such positions. Helpers leave it to
+the main player, which solves the same position.
+*/
+void Player::saveSolved(uint64_t P, uint64_t O, int empties, int best_move,
+        int score) {
+    if (solved != NULL && master == NULL && best_move != NO_MOVE
+            && empties >= SolvedCache::MIN_EMPTIES
+            && empties <= SolvedCache::MAX_EMPTIES) {
+        solved->add(P, O, best_move, score);
+    }
+}
@@ -0,0 +1,273 @@
+#include "engine.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sys/time.h>
+using namespace std;
+
+/*
+ * Commands, one per line, with moves written "x,y" and a pass "-1,-1":
+ *
+ *   newgame                          start position, black to move
+ *   position startpos [moves M ...]  start position, then the moves
+ *   position <board> <b|w> [moves M ...]
+ *                                    a 64-character board as read by
+ *                                    Board::setBoard, the side to move,
+ *                                    then the moves
+ *   go [depth N] [time MS] [clock MS] [nodes N] [infinite]
+ *                                    search the position: to depth N, for
+ *                                    MS milliseconds, on a clock with MS
+ *                                    left for the game, for about N nodes,
+ *                                    or until stop; with nothing given, to
+ *                                    the depth set by setoption
+ *   stop                             end the search early
+ *   eval                             static evaluation of the position
+ *   setoption <name> <value>         depth, endgame, threads, hash (MB) or
+ *                                    selectivity, for every later search
+ *   isready                          answered with "readyok" right away
+ *   quit
+ *
+ * Replies are space-separated key=value pairs, as in batch mode:
+ *
+ *   move=5,4 score=6 exact=0 depth=9 book=0 nodes=81234 time_ms=27
+ *   eval=-3
+ *   error=illegal_move
+ *
+ * The transposition table, history and caches carry over from one search
+ * and game to the next.
+ */
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+struct Engine {
+    Player *player;
+    Board board;
+    Side side;
+    // Depth searched when go does not give one
+    int depth;
+
+    bool searching;
+    pthread_t search_thread;
+    int ms_left;
+};
+
+/**
+ * Thread body of a search: finds a move for the engine's position and
+ * prints it. A search stopped before it found one plays any legal move.
+ */
+static void *runSearch(void *arg) {
+    Engine *engine = (Engine *) arg;
+    Player *player = engine->player;
+    long start = currentTimeMs();
+    int move = player->findMove(engine->board, engine->side,
+            engine->ms_left);
+    uint64_t moves = engine->board.moveMask(engine->side);
+    if (move == Player::NO_MOVE && moves != 0) {
+        move = firstSquare(moves);
+    }
+    SearchStats stats = player->totalStats();
+    printf("move=%d,%d score=%d exact=%d depth=%d book=%d nodes=%lu "
+            "time_ms=%ld\n",
+            move == Player::NO_MOVE ? -1 : move % 8,
+            move == Player::NO_MOVE ? -1 : move / 8,
+            stats.score, stats.exact ? 1 : 0, stats.depth,
+            stats.book ? 1 : 0, stats.nodes, currentTimeMs() - start);
+    fflush(stdout);
+    return NULL;
+}
+
+/**
+ * Waits for the search running, if any, to print its move.
+ */
+static void finishSearch(Engine &engine) {
+    if (engine.searching) {
+        pthread_join(engine.search_thread, NULL);
+        engine.player->clearStop();
+        engine.searching = false;
+    }
+}
+
+/**
+ * Plays the moves that follow on a position command on board, with side to
+ * move. Returns false, with the board left part way, if one is not legal.
+ */
+static bool playMoves(Board &board, Side &side, istringstream &words) {
+    string word;
+    if (!(words >> word)) {
+        return true;
+    }
+    if (word != "moves") {
+        return false;
+    }
+    while (words >> word) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        uint64_t moves = board.moveMask(side);
+        int x, y;
+        if (sscanf(word.c_str(), "%d,%d", &x, &y) != 2) {
+            return false;
+        }
+        if (x == -1 && y == -1) {
+            if (moves != 0 || board.moveMask(other) == 0) {
+                return false;
+            }
+        } else if (x < 0 || x > 7 || y < 0 || y > 7
+                || !(moves & squareBit(x + 8 * y))) {
+            return false;
+        } else {
+            board.doMove(x + 8 * y, side);
+        }
+        side = other;
+    }
+    return true;
+}
+
+/**
+ * Sets the engine's position from a position command. A bad board or an
+ * illegal move leaves the previous position alone.
+ */
+static void setPosition(Engine &engine, istringstream &words) {
+    Board board;
+    Side side = BLACK;
+    string start;
+    words >> start;
+    if (start != "startpos") {
+        string to_move;
+        words >> to_move;
+        if (start.size() != 64 || (to_move != "b" && to_move != "w")) {
+            printf("error=bad_position\n");
+            return;
+        }
+        char data[65];
+        strcpy(data, start.c_str());
+        board.setBoard(data);
+        side = (to_move == "b") ? BLACK : WHITE;
+    }
+    if (!playMoves(board, side, words)) {
+        printf("error=illegal_move\n");
+        return;
+    }
+    engine.board = board;
+    engine.side = side;
+}
+
+static void startSearch(Engine &engine, istringstream &words) {
+    Player *player = engine.player;
+    player->search_depth = engine.depth;
+    player->move_time = 0;
+    player->node_limit = 0;
+    engine.ms_left = -1;
+
+    bool has_depth = false, infinite = false;
+    string word;
+    while (words >> word) {
+        long value = 0;
+        if (word != "infinite" && !(words >> value)) {
+            printf("error=bad_command\n");
+            return;
+        }
+        if (word == "depth") {
+            player->search_depth = value;
+            has_depth = true;
+        } else if (word == "time") {
+            player->move_time = value;
+        } else if (word == "clock") {
+            engine.ms_left = value;
+        } else if (word == "nodes") {
+            player->node_limit = value;
+        } else if (word == "infinite") {
+            infinite = true;
+        } else {
+            printf("error=bad_command\n");
+            return;
+        }
+    }
+    // Without a depth, a node limit searches as deep as it gets to
+    if (infinite || (player->node_limit > 0 && !has_depth)) {
+        engine.ms_left = Player::UNTIL_STOPPED;
+    }
+
+    engine.searching = pthread_create(&engine.search_thread, NULL, runSearch,
+            &engine) == 0;
+}
+
+static void setOption(Engine &engine, istringstream &words) {
+    Player *player = engine.player;
+    string name;
+    double value;
+    if (!(words >> name >> value)) {
+        printf("error=bad_option\n");
+    } else if (name == "depth" && value >= 1) {
+        engine.depth = (int) value;
+    } else if (name == "endgame" && value >= 0) {
+        player->endgame_depth = (int) value;
+    } else if (name == "threads" && value >= 1) {
+        player->setThreads((int) value);
+    } else if (name == "hash" && value >= 1) {
+        player->tt->resize((int) value);
+    } else if (name == "selectivity" && value >= 0) {
+        player->selectivity = value;
+    } else {
+        printf("error=bad_option\n");
+    }
+}
+
+int runEngine(Player *player) {
+    Engine engine;
+    engine.player = player;
+    engine.side = BLACK;
+    engine.depth = player->search_depth;
+    engine.searching = false;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), stdin)) {
+        istringstream words(line);
+        string command;
+        if (!(words >> command) || command[0] == '#') {
+            continue;
+        }
+
+        // These are answered while a search runs
+        if (command == "isready") {
+            printf("readyok\n");
+            fflush(stdout);
+            continue;
+        }
+        if (command == "stop" || command == "quit") {
+            if (engine.searching) {
+                player->stop();
+            }
+            finishSearch(engine);
+            if (command == "quit") {
+                return 0;
+            }
+            continue;
+        }
+
+        finishSearch(engine);
+        if (command == "newgame") {
+            engine.board = Board();
+            engine.side = BLACK;
+        } else if (command == "position") {
+            setPosition(engine, words);
+        } else if (command == "go") {
+            startSearch(engine, words);
+        } else if (command == "eval") {
+            printf("eval=%d\n", engine.board.score(engine.side,
+                        engine.board.moveMask(engine.side), *player->weights));
+        } else if (command == "setoption") {
+            setOption(engine, words);
+        } else {
+            printf("error=bad_command\n");
+        }
+        fflush(stdout);
+    }
+    finishSearch(engine);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include "player.h"
+
+/*
+ * Engine mode: a long-lived player driven by text commands on stdin, one
+ * per line, so a match or analysis tool can play any number of games
+ * without restarting the process and losing what the transposition table
+ * and caches have learned. Searches run on a thread of their own, so stop
+ * can end one early; other commands wait for the search to finish first,
+ * which lets a client send a whole batch of commands at once.
+ *
+ * player must already have its book, solved position cache and threads
+ * set up. Returns when stdin ends or on quit.
+ */
+int runEngine(Player *player);
+
+#endif
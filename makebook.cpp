@@ -0,0 +1,131 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <sys/time.h>
+#include "player.h"
+using namespace std;
+
+/*
+ * Builds an opening book.
+ *
+ *   makebook <book> [plies] [depth] [margin]
+ *
+ * Starting from the initial position, every position reached is searched:
+ * each move to the given depth, and the best one goes in the book. The
+ * lines are then followed through every move scoring within margin of the
+ * best, for both sides, until the given number of plies has been played.
+ * Positions met again by transposition or symmetry are searched once.
+ */
+
+static const int BOOK_PLIES = 8;
+static const int BOOK_DEPTH = 8;
+static const int BOOK_MARGIN = 8;
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+struct BookBuilder {
+    Player *player;
+    int plies;
+    int depth;
+    int margin;
+    map<uint64_t, BookEntry> entries;
+
+    void expand(const Board &board, Side side, int ply);
+};
+
+void BookBuilder::expand(const Board &board, Side side, int ply) {
+    if (ply >= plies) {
+        return;
+    }
+    Side other = (side == BLACK) ? WHITE : BLACK;
+    uint64_t moves = board.moveMask(side);
+    if (moves == 0) {
+        if (board.moveMask(other) != 0) {
+            expand(board, other, ply);
+        }
+        return;
+    }
+
+    int symmetry;
+    uint64_t key = board.canonicalHash(side, symmetry);
+    if (entries.count(key)) {
+        return;
+    }
+
+    // Score every move
+    int squares[Player::MAX_MOVES], scores[Player::MAX_MOVES];
+    int count = 0, best = 0;
+    while (moves) {
+        int square = firstSquare(moves);
+        moves &= moves - 1;
+        Board child = board;
+        child.doMove(square, side);
+        int garbage;
+        squares[count] = square;
+        scores[count] = -player->minimax(child, other, depth - 1, -1000000,
+                +1000000, garbage);
+        if (scores[count] > scores[best]) {
+            best = count;
+        }
+        count++;
+    }
+
+    BookEntry &entry = entries[key];
+    entry.key = key;
+    entry.score = scores[best];
+    entry.move = Board::transformSquare(squares[best], symmetry);
+    entry.depth = depth;
+    entry.reserved[0] = entry.reserved[1] = 0;
+    entry.reserved[2] = entry.reserved[3] = 0;
+    if (entries.size() % 100 == 0) {
+        fprintf(stderr, "%lu positions\n", (unsigned long) entries.size());
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (scores[i] >= scores[best] - margin) {
+            Board child = board;
+            child.doMove(squares[i], side);
+            expand(child, other, ply + 1);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <book> [plies] [depth] [margin]"
+            << endl;
+        return 1;
+    }
+    Patterns::load(Patterns::WEIGHTS_FILE);
+
+    Player player(BLACK);
+    BookBuilder builder;
+    builder.player = &player;
+    builder.plies = (argc >= 3) ? atoi(argv[2]) : BOOK_PLIES;
+    builder.depth = (argc >= 4) ? atoi(argv[3]) : BOOK_DEPTH;
+    builder.margin = (argc >= 5) ? atoi(argv[4]) : BOOK_MARGIN;
+
+    long start = currentTimeMs();
+    Board board;
+    builder.expand(board, BLACK, 0);
+
+    vector<BookEntry> entries;
+    for (map<uint64_t, BookEntry>::const_iterator it = builder.entries.begin();
+            it != builder.entries.end(); ++it) {
+        entries.push_back(it->second);
+    }
+    if (!OpeningBook::write(argv[1], entries)) {
+        cerr << "cannot write " << argv[1] << endl;
+        return 1;
+    }
+    printf("makebook positions=%lu plies=%d depth=%d margin=%d time_ms=%ld\n",
+            (unsigned long) entries.size(), builder.plies, builder.depth,
+            builder.margin, currentTimeMs() - start);
+    return 0;
+}
@@ -0,0 +1,619 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "player.h"
+using namespace std;
+
+/*
+ * Plays two engine configurations against each other.
+ *
+ *   match <first> <second> [games] [threads] [openings]
+ *
+ * A configuration is a comma-separated list of settings, any of which may be
+ * left out:
+ *
+ *   depth=N     midgame search depth (Player::DEPTH)
+ *   endgame=N   empty squares from which the game is solved exactly
+ *               (Player::DEPTH_ENDGAME)
+ *   time=MS     search every move for MS milliseconds instead of to depth
+ *   clock=MS    play with a game clock of MS milliseconds; running out of
+ *               time loses the game
+ *   weights=F   evaluation weights from the weights file F
+ *   probcut=F   Multi-ProbCut parameters from the file F; with weights of
+ *               its own and no probcut, a configuration does not cut, as
+ *               probcut.txt was fitted for weights.bin
+ *   book=F      play from the opening book F
+ *   hash=MB     transposition table size (MATCH_HASH_MB)
+ *   selectivity=S
+ *               Multi-ProbCut confidence in standard deviations, 0 for none
+ *
+ * for example "depth=6,weights=new.bin" against "depth=6". An empty string
+ * or "default" is the engine as shipped, with weights.bin and probcut.txt
+ * if there are any.
+ *
+ * Games start from balanced openings: the move lists in the openings file,
+ * one per line such as "f5d6c3d3c4", or else random openings of
+ * OPENING_PLIES moves whose OPENING_DEPTH search scores within
+ * OPENING_MARGIN of even. Each opening is played twice with the colours
+ * swapped, so an opening that favours one side does not favour either
+ * configuration. Games are played in parallel on the given number of
+ * threads, each with a player of either configuration.
+ *
+ * Results are from the first configuration's point of view. Besides the
+ * score and Elo difference, a sequential probability ratio test of
+ * SPRT_ELO0 against SPRT_ELO1 Elo decides as soon as it can whether the
+ * first configuration is better; the match then stops before the given
+ * number of games. The games still being played when it decides are
+ * finished but left out of the results, which stay the ones the test
+ * decided on, and only counted in late_games. Progress goes to stderr and
+ * the result to stdout as key=value pairs:
+ *
+ *   match games=1200 wins=530 draws=44 losses=626 score=0.460 elo=-27.8
+ *       elo_error=19.3 llr=-2.95 lower=-2.94 upper=2.94 sprt=H0 ...
+ */
+
+static const int MATCH_GAMES = 1000;
+static const int MATCH_HASH_MB = 8;
+static const int OPENING_PLIES = 8;
+static const int OPENING_DEPTH = 4;
+static const int OPENING_MARGIN = 4 * Patterns::UNITS_PER_DISC;
+static const double SPRT_ELO0 = 0;
+static const double SPRT_ELO1 = 5;
+static const double SPRT_ALPHA = 0.05;
+static const double SPRT_BETA = 0.05;
+static const int PROGRESS_INTERVAL = 100;
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+struct EngineConfig {
+    int depth;
+    int endgame;
+    int move_time;
+    int clock;
+    int hash;
+    double selectivity;
+    const Patterns::WeightSet *weights;
+    const ProbCut::ParamSet *probcut;
+    OpeningBook *book;
+};
+
+// Multi-ProbCut parameters that never cut
+static ProbCut::ParamSet no_probcut;
+
+/*
+ * Parses a configuration. Returns false, after saying why, if it has an
+ * unknown setting or a file that cannot be read.
+ */
+static bool parseConfig(const char *text, EngineConfig &config) {
+    config.depth = Player::DEPTH;
+    config.endgame = Player::DEPTH_ENDGAME;
+    config.move_time = 0;
+    config.clock = 0;
+    config.hash = MATCH_HASH_MB;
+    config.selectivity = Player::SELECTIVITY_TENTHS / 10.0;
+    config.weights = &Patterns::standard;
+    config.probcut = NULL;
+    config.book = NULL;
+    if (!strcmp(text, "default")) {
+        config.probcut = &ProbCut::standard;
+        return true;
+    }
+
+    string settings = text;
+    size_t start = 0;
+    while (start < settings.size()) {
+        size_t end = settings.find(',', start);
+        if (end == string::npos) {
+            end = settings.size();
+        }
+        string setting = settings.substr(start, end - start);
+        start = end + 1;
+        size_t equals = setting.find('=');
+        if (equals == string::npos) {
+            cerr << "bad setting " << setting << endl;
+            return false;
+        }
+        string name = setting.substr(0, equals);
+        string value = setting.substr(equals + 1);
+
+        if (name == "depth") {
+            config.depth = atoi(value.c_str());
+        } else if (name == "endgame") {
+            config.endgame = atoi(value.c_str());
+        } else if (name == "time") {
+            config.move_time = atoi(value.c_str());
+        } else if (name == "clock") {
+            config.clock = atoi(value.c_str());
+        } else if (name == "hash") {
+            config.hash = atoi(value.c_str());
+        } else if (name == "selectivity") {
+            config.selectivity = atof(value.c_str());
+        } else if (name == "weights") {
+            Patterns::WeightSet *weights =
+                Patterns::copyWeights(Patterns::standard);
+            if (!Patterns::load(value.c_str(), *weights)) {
+                cerr << "cannot load weights " << value << endl;
+                return false;
+            }
+            config.weights = weights;
+        } else if (name == "probcut") {
+            ProbCut::ParamSet *probcut = new ProbCut::ParamSet();
+            if (!ProbCut::load(value.c_str(), *probcut)) {
+                cerr << "cannot load probcut " << value << endl;
+                return false;
+            }
+            config.probcut = probcut;
+        } else if (name == "book") {
+            config.book = new OpeningBook();
+            if (!config.book->open(value.c_str())) {
+                cerr << "cannot open book " << value << endl;
+                return false;
+            }
+        } else {
+            cerr << "unknown setting " << name << endl;
+            return false;
+        }
+    }
+    if (config.probcut == NULL) {
+        config.probcut = (config.weights == &Patterns::standard)
+            ? &ProbCut::standard : &no_probcut;
+    }
+    return true;
+}
+
+static void configure(Player &player, const EngineConfig &config) {
+    player.search_depth = config.depth;
+    player.endgame_depth = config.endgame;
+    player.move_time = config.move_time;
+    player.weights = config.weights;
+    player.selectivity = config.selectivity;
+    player.probcut = config.probcut;
+    player.book = config.book;
+    player.tt->resize(config.hash);
+}
+
+/*
+ * Parses a move list into squares, as train does. Returns false if it
+ * holds anything but coordinates, whitespace and "--" or "pa" for passes.
+ */
+static bool parseOpening(const char *line, vector<int> &moves) {
+    moves.clear();
+    for (const char *c = line; *c; ) {
+        if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+            c++;
+        } else if (!strncmp(c, "--", 2) || !strncmp(c, "pa", 2)
+                || !strncmp(c, "PA", 2)) {
+            c += 2;
+        } else {
+            int x = (*c >= 'a' && *c <= 'h') ? *c - 'a'
+                  : (*c >= 'A' && *c <= 'H') ? *c - 'A' : -1;
+            int y = c[1] - '1';
+            if (x < 0 || y < 0 || y > 7) {
+                return false;
+            }
+            moves.push_back(x + 8 * y);
+            c += 2;
+        }
+    }
+    return true;
+}
+
+/*
+ * Plays the moves of an opening from the starting position, skipping the
+ * turn of a side that has to pass. Returns false if a move is illegal.
+ */
+static bool playOpening(const vector<int> &opening, Board &board,
+        Side &side) {
+    board = Board();
+    side = BLACK;
+    for (size_t i = 0; i < opening.size(); i++) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        if (board.moveMask(side) == 0) {
+            side = other;
+            other = (side == BLACK) ? WHITE : BLACK;
+        }
+        if (!(board.moveMask(side) & squareBit(opening[i]))) {
+            return false;
+        }
+        board.doMove(opening[i], side);
+        side = other;
+    }
+    return true;
+}
+
+static bool readOpenings(const char *filename,
+        vector<vector<int> > &openings) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char line[1024];
+    vector<int> opening;
+    Board board;
+    Side side;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] != '#' && parseOpening(line, opening)
+                && !opening.empty() && playOpening(opening, board, side)) {
+            openings.push_back(opening);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/*
+ * Makes random openings until there are the given number. Openings that
+ * are the same up to symmetry, and ones that do not look even to a shallow
+ * search, are thrown away. The generator has a fixed seed, so every match
+ * of the same length uses the same openings.
+ */
+static void randomOpenings(int count, vector<vector<int> > &openings) {
+    Player player(BLACK);
+    player.search_depth = OPENING_DEPTH;
+    player.endgame_depth = 0;
+    set<uint64_t> seen;
+    unsigned int seed = 1;
+    vector<int> opening;
+
+    for (int tries = 0; (int) openings.size() < count
+            && tries < 1000 * count; tries++) {
+        Board board;
+        Side side = BLACK;
+        opening.clear();
+        while ((int) opening.size() < OPENING_PLIES) {
+            uint64_t moves = board.moveMask(side);
+            Side other = (side == BLACK) ? WHITE : BLACK;
+            if (moves == 0) {
+                if (board.moveMask(other) == 0) {
+                    break;
+                }
+                side = other;
+                continue;
+            }
+            seed = seed * 1103515245 + 12345;
+            int pick = (seed >> 16) % bitCount(moves);
+            while (pick--) {
+                moves &= moves - 1;
+            }
+            opening.push_back(firstSquare(moves));
+            board.doMove(opening.back(), side);
+            side = other;
+        }
+
+        int symmetry;
+        if (board.moveMask(side) == 0 || !seen.insert(
+                board.canonicalHash(side, symmetry)).second) {
+            continue;
+        }
+        int garbage;
+        player.tt->clear();
+        int score = player.minimax(board, side, OPENING_DEPTH, -1000000,
+                +1000000, garbage);
+        if (abs(score) <= OPENING_MARGIN) {
+            openings.push_back(opening);
+        }
+    }
+}
+
+/*
+ * Match state shared by the threads playing games. Game i starts from
+ * opening i / 2, with the first configuration black in even games.
+ */
+struct Match {
+    pthread_mutex_t lock;
+    EngineConfig configs[2];
+    vector<vector<int> > openings;
+    int games;
+    int next_game;
+    bool decided;
+
+    // Per opening, how many of its games are over and the score of the
+    // first to finish, until both are and the pair is counted
+    vector<int> pair_finished;
+    vector<int> pair_score;
+
+    // Results for the first configuration, over whole pairs of games up to
+    // the SPRT deciding, and the games finished after that
+    int wins;
+    int draws;
+    int losses;
+    int late_games;
+    int time_losses[2];
+    int illegal_moves[2];
+    long start;
+};
+
+/*
+ * Plays a game from an opening. Returns the final disc difference for
+ * black, or +-64 when a side loses on time or tries an illegal move; sets
+ * loser to that side in those cases and to -1 otherwise.
+ */
+static int playGame(Player *players[2], const EngineConfig *configs[2],
+        const vector<int> &opening, int &loser, bool &illegal) {
+    Board board;
+    Side side;
+    playOpening(opening, board, side);
+    long clock[2];
+    clock[BLACK] = configs[BLACK]->clock;
+    clock[WHITE] = configs[WHITE]->clock;
+    loser = -1;
+    illegal = false;
+    for (int i = 0; i < 2; i++) {
+        players[i]->tt->clear();
+    }
+
+    while (true) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        uint64_t moves = board.moveMask(side);
+        if (moves == 0) {
+            if (board.moveMask(other) == 0) {
+                break;
+            }
+            side = other;
+            continue;
+        }
+
+        long start = currentTimeMs();
+        int square = players[side]->findMove(board, side,
+                (configs[side]->clock > 0) ? (int) clock[side] : -1);
+        if (configs[side]->clock > 0) {
+            clock[side] -= currentTimeMs() - start;
+            if (clock[side] < 0) {
+                loser = side;
+                break;
+            }
+        }
+        if (square == Player::NO_MOVE || !(moves & squareBit(square))) {
+            loser = side;
+            illegal = true;
+            break;
+        }
+        board.doMove(square, side);
+        side = other;
+    }
+
+    if (loser >= 0) {
+        return (loser == BLACK) ? -64 : 64;
+    }
+    return board.score_endgame(BLACK);
+}
+
+/*
+ * Score of the first configuration per game, its variance, and the Elo
+ * difference that score means.
+ */
+static double scoreOf(const Match &match) {
+    int played = match.wins + match.draws + match.losses;
+    return (match.wins + 0.5 * match.draws) / played;
+}
+
+static double varianceOf(const Match &match) {
+    int played = match.wins + match.draws + match.losses;
+    double score = scoreOf(match);
+    return (match.wins * (1 - score) * (1 - score)
+            + match.draws * (0.5 - score) * (0.5 - score)
+            + match.losses * score * score) / played;
+}
+
+static double eloOf(double score) {
+    if (score <= 0) {
+        score = 1e-6;
+    } else if (score >= 1) {
+        score = 1 - 1e-6;
+    }
+    return -400 * log10(1 / score - 1);
+}
+
+static double expectedScore(double elo) {
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+/*
+ * Log-likelihood ratio of SPRT_ELO1 against SPRT_ELO0 for the results so
+ * far, in the normal approximation of the generalized SPRT.
+ */
+static double llrOf(const Match &match) {
+    int played = match.wins + match.draws + match.losses;
+    double variance = varianceOf(match);
+    if (variance <= 0) {
+        return 0;
+    }
+    double s0 = expectedScore(SPRT_ELO0), s1 = expectedScore(SPRT_ELO1);
+    return played * (s1 - s0) * (2 * scoreOf(match) - s0 - s1)
+        / (2 * variance);
+}
+
+static void printResult(const Match &match, FILE *out, bool final) {
+    int played = match.wins + match.draws + match.losses;
+    double score = scoreOf(match);
+    // 95% confidence interval of the score, as Elo
+    double margin = 1.96 * sqrt(varianceOf(match) / played);
+    double elo = eloOf(score);
+    double error = (eloOf(score + margin) - eloOf(score - margin)) / 2;
+    double llr = llrOf(match);
+    double lower = log(SPRT_BETA / (1 - SPRT_ALPHA));
+    double upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+    const char *sprt = (llr >= upper) ? "H1" : (llr <= lower) ? "H0" : "-";
+
+    fprintf(out, "match games=%d wins=%d draws=%d losses=%d score=%.3f "
+            "elo=%.1f elo_error=%.1f llr=%.2f lower=%.2f upper=%.2f sprt=%s",
+            played, match.wins, match.draws, match.losses, score, elo, error,
+            llr, lower, upper, sprt);
+    if (final) {
+        fprintf(out, " late_games=%d openings=%lu time_losses=%d,%d "
+                "illegal_moves=%d,%d time_ms=%ld", match.late_games,
+                (unsigned long) match.openings.size(),
+                match.time_losses[0], match.time_losses[1],
+                match.illegal_moves[0], match.illegal_moves[1],
+                currentTimeMs() - match.start);
+    }
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+/*
+ * Adds a game's score for the first configuration to the results. Called
+ * with the lock held.
+ */
+static void countResult(Match &match, int score) {
+    if (score > 0) {
+        match.wins++;
+    } else if (score < 0) {
+        match.losses++;
+    } else {
+        match.draws++;
+    }
+}
+
+static void *playGames(void *arg) {
+    Match *match = (Match *) arg;
+    Player first(BLACK), second(BLACK);
+    configure(first, match->configs[0]);
+    configure(second, match->configs[1]);
+
+    while (true) {
+        pthread_mutex_lock(&match->lock);
+        int game = match->next_game++;
+        bool done = match->decided || game >= match->games;
+        pthread_mutex_unlock(&match->lock);
+        if (done) {
+            break;
+        }
+
+        // Index 0 of the configuration is the first one's
+        int first_side = (game % 2 == 0) ? BLACK : WHITE;
+        Player *players[2];
+        const EngineConfig *configs[2];
+        players[first_side] = &first;
+        players[1 - first_side] = &second;
+        configs[first_side] = &match->configs[0];
+        configs[1 - first_side] = &match->configs[1];
+        int loser;
+        bool illegal;
+        int black_score = playGame(players, configs,
+                match->openings[game / 2], loser, illegal);
+        int score = (first_side == BLACK) ? black_score : -black_score;
+
+        pthread_mutex_lock(&match->lock);
+        // Results only count once both colours of the opening are played,
+        // or the one colour if the match ends halfway through its pair
+        int pair = game / 2;
+        int pair_games = (2 * pair + 1 < match->games) ? 2 : 1;
+        bool counted = false;
+        if (++match->pair_finished[pair] < pair_games) {
+            match->pair_score[pair] = score;
+        } else if (match->decided) {
+            // Leave the results the test decided on as they are
+            match->late_games += pair_games;
+        } else {
+            countResult(*match, score);
+            if (pair_games == 2) {
+                countResult(*match, match->pair_score[pair]);
+            }
+            counted = true;
+        }
+        if (loser >= 0) {
+            int config = (loser == first_side) ? 0 : 1;
+            if (illegal) {
+                match->illegal_moves[config]++;
+            } else {
+                match->time_losses[config]++;
+            }
+        }
+        if (counted) {
+            int played = match->wins + match->draws + match->losses;
+            if (played % PROGRESS_INTERVAL == 0) {
+                printResult(*match, stderr, false);
+            }
+            double llr = llrOf(*match);
+            if (llr >= log((1 - SPRT_BETA) / SPRT_ALPHA)
+                    || llr <= log(SPRT_BETA / (1 - SPRT_ALPHA))) {
+                match->decided = true;
+            }
+        }
+        pthread_mutex_unlock(&match->lock);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "usage: " << argv[0]
+            << " <first> <second> [games] [threads] [openings]" << endl;
+        return 1;
+    }
+    // Configurations without weights of their own use weights.bin, and
+    // probcut.txt unless given other parameters
+    Patterns::load(Patterns::WEIGHTS_FILE);
+    ProbCut::load(ProbCut::PROBCUT_FILE);
+
+    Match match;
+    if (!parseConfig(argv[1], match.configs[0])
+            || !parseConfig(argv[2], match.configs[1])) {
+        return 1;
+    }
+    match.games = (argc >= 4) ? atoi(argv[3]) : MATCH_GAMES;
+    int threads = (argc >= 5) ? atoi(argv[4])
+        : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (argc >= 6) {
+        if (!readOpenings(argv[5], match.openings)) {
+            cerr << "cannot read " << argv[5] << endl;
+            return 1;
+        }
+    } else {
+        randomOpenings((match.games + 1) / 2, match.openings);
+    }
+    if (match.openings.empty()) {
+        cerr << "no openings" << endl;
+        return 1;
+    }
+    // Use the openings over again if there are too few of them
+    if ((int) match.openings.size() * 2 < match.games) {
+        for (int i = 0; (int) match.openings.size() * 2 < match.games; i++) {
+            vector<int> opening = match.openings[i];
+            match.openings.push_back(opening);
+        }
+    }
+
+    pthread_mutex_init(&match.lock, NULL);
+    match.next_game = 0;
+    match.decided = false;
+    match.pair_finished.assign((match.games + 1) / 2, 0);
+    match.pair_score.assign((match.games + 1) / 2, 0);
+    match.wins = match.draws = match.losses = match.late_games = 0;
+    match.time_losses[0] = match.time_losses[1] = 0;
+    match.illegal_moves[0] = match.illegal_moves[1] = 0;
+    match.start = currentTimeMs();
+
+    vector<pthread_t> workers(threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, playGames, &match);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&match.lock);
+
+    if (match.wins + match.draws + match.losses == 0) {
+        cerr << "no games played" << endl;
+        return 1;
+    }
+    printResult(match, stdout, true);
+    return 0;
+}
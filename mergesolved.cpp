@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "solved.h"
+using namespace std;
+
+/*
+ * Folds the solved position log into the index.
+ *
+ *   mergesolved [index] [log]
+ *
+ * Reads the index, if there is one, and the log, writes the positions of
+ * both to a new index, and empties the log. Run it while no engine is
+ * using the cache, or positions they append meanwhile are lost.
+ */
+
+int main(int argc, char *argv[]) {
+    if (argc > 3) {
+        cerr << "usage: " << argv[0] << " [index] [log]" << endl;
+        return 1;
+    }
+    const char *index_file = (argc >= 2) ? argv[1] : SolvedCache::INDEX_FILE;
+    const char *log_file = (argc >= 3) ? argv[2] : SolvedCache::LOG_FILE;
+
+    vector<SolvedEntry> entries;
+    FILE *file = fopen(index_file, "rb");
+    if (file != NULL) {
+        fclose(file);
+        if (!SolvedCache::readIndex(index_file, entries)) {
+            cerr << index_file << " is not a solved position index" << endl;
+            return 1;
+        }
+    }
+    size_t indexed = entries.size();
+    SolvedCache::readLog(log_file, entries);
+    size_t logged = entries.size() - indexed;
+
+    if (!SolvedCache::write(index_file, entries)) {
+        cerr << "cannot write " << index_file << endl;
+        return 1;
+    }
+    file = fopen(log_file, "wb");
+    if (file != NULL) {
+        fclose(file);
+    }
+    printf("mergesolved indexed=%lu logged=%lu positions=%lu\n",
+            (unsigned long) indexed, (unsigned long) logged,
+            (unsigned long) entries.size());
+    return 0;
+}
@@ -0,0 +1,385 @@
+#include "pattern.h"
+#include "board.h"
+#include <stdio.h>
+#include <string.h>
+#include <cassert>
+
+Patterns::Feature Patterns::features[64][MAX_PER_SQUARE + 1];
+int Patterns::instance_type[INSTANCES];
+int Patterns::instance_offset[INSTANCES];
+int Patterns::type_offset[TYPES + 1];
+int Patterns::type_size[TYPES];
+Patterns::WeightSet Patterns::standard;
+bool Patterns::initialized = false;
+const char *const Patterns::WEIGHTS_FILE = "weights.bin";
+
+/*
+ * Start of a weights file, followed by the number of stages and of weights
+ * per stage as 32-bit integers, then for each stage its mobility and
+ * stability weights and its pattern weights, all 16-bit, in the machine's
+ * byte order. Files of the first version have no stability weights.
+ */
+static const char WEIGHTS_MAGIC[8] = {'N', 'o', 'o', 'b', 'W', 't', 's', '2'};
+static const char WEIGHTS_MAGIC_V1[8] =
+    {'N', 'o', 'o', 'b', 'W', 't', 's', '1'};
+
+/*
+ * Squares of the first instance of each pattern, as x + 8 * y, and how many
+ * of the board symmetries (in the order of INSTANCE_SYMMETRIES) give its
+ * instances.
+ */
+static const int MAX_SQUARES = 10;
+
+struct PatternShape {
+    int length;
+    int squares[MAX_SQUARES];
+    int symmetries;
+};
+
+static const PatternShape SHAPES[Patterns::TYPES] = {
+    // a1-h1 plus b2 and g2
+    {10, {0, 1, 2, 3, 4, 5, 6, 7, 9, 14}, 4},
+    // a1-e1 and a2-e2
+    {10, {0, 1, 2, 3, 4, 8, 9, 10, 11, 12}, 8},
+    // a1-c3
+    {9, {0, 1, 2, 8, 9, 10, 16, 17, 18}, 4},
+    // a1-h8
+    {8, {0, 9, 18, 27, 36, 45, 54, 63}, 2},
+    // b1-h7
+    {7, {1, 10, 19, 28, 37, 46, 55}, 4},
+    // c1-h6
+    {6, {2, 11, 20, 29, 38, 47}, 4},
+    // d1-h5
+    {5, {3, 12, 21, 30, 39}, 4},
+    // e1-h4
+    {4, {4, 13, 22, 31}, 4}
+};
+
+/*
+ * Symmetries, as numbered by Board::transform, that map the first instance
+ * of a pattern to the others: the four rotations, then the four rotations
+ * of the board transposed.
+ */
+static const int INSTANCE_SYMMETRIES[8] = {0, 5, 3, 6, 4, 1, 7, 2};
+
+/*
+ * For each pattern and symmetry, where each square of the first instance
+ * lands in the instance the symmetry maps it to.
+ */
+static int image_positions[Patterns::TYPES][8][MAX_SQUARES];
+
+/**
+ * Builds the square-to-instance tables and seeds the weights. Must be called
+ * before any Board is made; Board's constructor does so.
+ */
+void Patterns::init() {
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+
+    int counts[64];
+    memset(counts, 0, sizeof(counts));
+    int instance = 0;
+    type_offset[0] = 0;
+    for (int type = 0; type < TYPES; type++) {
+        const PatternShape &shape = SHAPES[type];
+        for (int s = 0; s < shape.symmetries; s++) {
+            int power = 1;
+            for (int i = 0; i < shape.length; i++) {
+                int square = Board::transformSquare(shape.squares[i],
+                        INSTANCE_SYMMETRIES[s]);
+                assert(counts[square] < MAX_PER_SQUARE);
+                Feature &feature = features[square][counts[square]++];
+                feature.instance = instance;
+                feature.power = power;
+                power *= 3;
+            }
+            instance_type[instance] = type;
+            instance_offset[instance++] = type_offset[type];
+        }
+        int size = 1;
+        for (int i = 0; i < shape.length; i++) {
+            size *= 3;
+        }
+        type_size[type] = size;
+        type_offset[type + 1] = type_offset[type] + size;
+    }
+    assert(instance == INSTANCES);
+    for (int square = 0; square < 64; square++) {
+        features[square][counts[square]].instance = INSTANCES;
+    }
+
+    // Every symmetry maps the first instance of a pattern onto one of its
+    // instances, with the squares in some other order
+    for (int type = 0; type < TYPES; type++) {
+        const PatternShape &shape = SHAPES[type];
+        for (int symmetry = 0; symmetry < 8; symmetry++) {
+            bool found = false;
+            for (int s = 0; s < shape.symmetries && !found; s++) {
+                found = true;
+                for (int i = 0; i < shape.length && found; i++) {
+                    int image = Board::transformSquare(shape.squares[i],
+                            symmetry);
+                    found = false;
+                    for (int j = 0; j < shape.length; j++) {
+                        if (Board::transformSquare(shape.squares[j],
+                                    INSTANCE_SYMMETRIES[s]) == image) {
+                            image_positions[type][symmetry][i] = j;
+                            found = true;
+                        }
+                    }
+                }
+            }
+            assert(found);
+        }
+    }
+
+    allocate(standard);
+    seedWeights();
+}
+
+/**
+ * Allocates the pattern tables of a weight set.
+ */
+void Patterns::allocate(WeightSet &set) {
+    int16_t *all = new int16_t[STAGES * type_offset[TYPES]];
+    for (int stage = 0; stage < STAGES; stage++) {
+        set.weights[stage] = all + stage * type_offset[TYPES];
+    }
+}
+
+/**
+ * Returns a new weight set holding a copy of the given one. It is never
+ * freed, like the standard set.
+ */
+Patterns::WeightSet *Patterns::copyWeights(const WeightSet &from) {
+    init();
+    WeightSet *set = new WeightSet;
+    allocate(*set);
+    for (int stage = 0; stage < STAGES; stage++) {
+        memcpy(set->weights[stage], from.weights[stage],
+                type_offset[TYPES] * sizeof(int16_t));
+        set->mobility[stage] = from.mobility[stage];
+        set->stability[stage] = from.stability[stage];
+    }
+    set->symmetric = from.symmetric;
+    return set;
+}
+
+/**
+ * Returns the index, in the table of the given pattern, of the
+ * configuration that an instance reading the given index shows once the
+ * board is mapped through a symmetry, as numbered by Board::transform.
+ */
+int Patterns::symmetricIndex(int type, int index, int symmetry) {
+    const PatternShape &shape = SHAPES[type];
+    const int *positions = image_positions[type][symmetry];
+    int image = 0;
+    for (int i = 0; i < shape.length; i++) {
+        int power = 1;
+        for (int j = 0; j < positions[i]; j++) {
+            power *= 3;
+        }
+        image += (index % 3) * power;
+        index /= 3;
+    }
+    return image;
+}
+
+/**
+ * Returns whether every table of a weight set gives all the symmetric
+ * images of a configuration the same weight, so the evaluation does not
+ * change when the board is rotated or mirrored. A mirror and a quarter
+ * turn make up all eight symmetries, so only those two are checked.
+ */
+bool Patterns::isSymmetric(const WeightSet &set) {
+    static const int GENERATORS[2] = {1, 5};
+    for (int type = 0; type < TYPES; type++) {
+        for (int index = 0; index < type_size[type]; index++) {
+            for (int g = 0; g < 2; g++) {
+                int image = symmetricIndex(type, index, GENERATORS[g]);
+                if (image == index) {
+                    continue;
+                }
+                for (int stage = 0; stage < STAGES; stage++) {
+                    const int16_t *table = set.weights[stage]
+                        + type_offset[type];
+                    if (table[index] != table[image]) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Sets every stage's standard weights to the square table and the 0.2 mobility
+ * weight the engine used before. Each square's value is shared out evenly
+ * among the instances it belongs to, so the patterns add up to the square
+ * table score, to within rounding.
+ */
+void Patterns::seedWeights() {
+    int counts[64];
+    for (int square = 0; square < 64; square++) {
+        counts[square] = 0;
+        while (features[square][counts[square]].instance != INSTANCES) {
+            counts[square]++;
+        }
+    }
+
+    for (int type = 0; type < TYPES; type++) {
+        const PatternShape &shape = SHAPES[type];
+        int16_t *table = standard.weights[0] + type_offset[type];
+        for (int index = 0; index < type_size[type]; index++) {
+            double weight = 0;
+            int digits = index;
+            for (int i = 0; i < shape.length; i++) {
+                int square = shape.squares[i];
+                double share = (double) SCALE * Board::heuristic_values[square]
+                        / counts[square];
+                if (digits % 3 == 1) {
+                    weight += share;
+                } else if (digits % 3 == 2) {
+                    weight -= share;
+                }
+                digits /= 3;
+            }
+            table[index] = (int16_t) (weight < 0 ? weight - 0.5 : weight + 0.5);
+        }
+    }
+    for (int stage = 1; stage < STAGES; stage++) {
+        memcpy(standard.weights[stage], standard.weights[0],
+                type_offset[TYPES] * sizeof(int16_t));
+    }
+    for (int stage = 0; stage < STAGES; stage++) {
+        standard.mobility[stage] = 20 * SCALE;
+        standard.stability[stage] = SEED_STABILITY * SCALE;
+    }
+    standard.symmetric = isSymmetric(standard);
+}
+
+/**
+ * Replaces a weight set with the one in a weights file. Returns false,
+ * leaving the set alone, if the file cannot be read or was made for other
+ * patterns.
+ */
+bool Patterns::load(const char *filename, WeightSet &set) {
+    init();
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    char magic[8];
+    int32_t stages, count;
+    bool ok = fread(magic, sizeof(magic), 1, file) == 1
+        && (!memcmp(magic, WEIGHTS_MAGIC, sizeof(magic))
+            || !memcmp(magic, WEIGHTS_MAGIC_V1, sizeof(magic)))
+        && fread(&stages, sizeof(stages), 1, file) == 1 && stages == STAGES
+        && fread(&count, sizeof(count), 1, file) == 1
+        && count == type_offset[TYPES];
+    // Weights before the pattern weights of each stage
+    int header = (ok && !memcmp(magic, WEIGHTS_MAGIC, sizeof(magic))) ? 2 : 1;
+    int16_t *loaded = new int16_t[STAGES * (type_offset[TYPES] + header)];
+    ok = ok && fread(loaded, sizeof(int16_t), STAGES * (count + header), file)
+            == (size_t) (STAGES * (count + header));
+    fclose(file);
+
+    if (ok) {
+        for (int stage = 0; stage < STAGES; stage++) {
+            const int16_t *from = loaded
+                + stage * (type_offset[TYPES] + header);
+            set.mobility[stage] = from[0];
+            set.stability[stage] = (header == 2) ? from[1] : 0;
+            memcpy(set.weights[stage], from + header,
+                    type_offset[TYPES] * sizeof(int16_t));
+        }
+        set.symmetric = isSymmetric(set);
+    }
+    delete[] loaded;
+    return ok;
+}
+
+/**
+ * Writes a weight set to a file that load can read. Returns false if the
+ * file cannot be written.
+ */
+bool Patterns::save(const char *filename, const WeightSet &set) {
+    init();
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    int32_t stages = STAGES, count = type_offset[TYPES];
+    bool ok = fwrite(WEIGHTS_MAGIC, sizeof(WEIGHTS_MAGIC), 1, file) == 1
+        && fwrite(&stages, sizeof(stages), 1, file) == 1
+        && fwrite(&count, sizeof(count), 1, file) == 1;
+    for (int stage = 0; ok && stage < STAGES; stage++) {
+        ok = fwrite(&set.mobility[stage], sizeof(int16_t), 1, file) == 1
+            && fwrite(&set.stability[stage], sizeof(int16_t), 1, file) == 1
+            && fwrite(set.weights[stage], sizeof(int16_t), count, file)
+                == (size_t) count;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * Computes the index of every instance from scratch.
+ */
+void Patterns::index(uint64_t black, uint64_t white, uint16_t indices[]) {
+    memset(indices, 0, INSTANCES * sizeof(uint16_t));
+    for (int square = 0; square < 64; square++) {
+        int digit = (black & squareBit(square)) ? 1
+                  : (white & squareBit(square)) ? 2 : 0;
+        for (const Feature *f = features[square]; f->instance != INSTANCES;
+                f++) {
+            indices[f->instance] += digit * f->power;
+        }
+    }
+}
+
+/**
+ * Returns the stage of a position with the given number of discs.
+ */
+int Patterns::stage(int discs) {
+    int stage = (discs - 4) / 4;
+    return stage < STAGES ? stage : STAGES - 1;
+}
+
+/**
+ * Sums the weights of the given instance indices for the stage of a
+ * position with the given number of discs. The result is from black's point
+ * of view, in evaluation units.
+ */
+int Patterns::evaluate(const uint16_t indices[], int discs,
+        const WeightSet &set) {
+    const int16_t *table = set.weights[stage(discs)];
+    int sum = 0;
+    for (int i = 0; i < INSTANCES; i++) {
+        sum += table[instance_offset[i] + indices[i]];
+    }
+    return sum / SCALE;
+}
+
+/**
+ * Returns the evaluation term for the given Board::mobility, which runs
+ * from -100 to 100, at the stage of a position with the given number of
+ * discs.
+ */
+double Patterns::mobilityTerm(double mobility, int discs,
+        const WeightSet &set) {
+    return set.mobility[stage(discs)] * mobility / (100.0 * SCALE);
+}
+
+/**
+ * Returns the evaluation term for the given Board::stability, the
+ * difference in stable stones, at the stage of a position with the given
+ * number of discs.
+ */
+double Patterns::stabilityTerm(int stability, int discs,
+        const WeightSet &set) {
+    return (double) set.stability[stage(discs)] * stability / SCALE;
+}
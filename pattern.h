@@ -0,0 +1,106 @@
+#ifndef __PATTERN_H__
+#define __PATTERN_H__
+
+#include <stdint.h>
+
+/*
+ * Pattern evaluation. The board is covered by lines and blocks of squares
+ * (edges with their X-squares, 2x5 and 3x3 corner blocks, and diagonals),
+ * each in all its symmetric positions. Every instance of a pattern reads
+ * its squares as a base-3 number (0 empty, 1 black, 2 white) and looks up
+ * a weight for that configuration; the evaluation is the sum of the
+ * weights, from black's point of view.
+ *
+ * The instances of one pattern share a table, and there is one set of
+ * tables per game stage, by number of discs on the board. Board keeps the
+ * index of every instance up to date as stones are placed and flipped.
+ * Each stage also weights Board::mobility and Board::stability.
+ *
+ * The weights start out as a copy of the square table; trained ones are
+ * read from a weights file made by the train tool.
+ */
+class Patterns {
+
+public:
+    enum Type {
+        EDGE_2X, CORNER_2X5, CORNER_3X3, DIAG_8, DIAG_7, DIAG_6, DIAG_5,
+        DIAG_4, TYPES
+    };
+
+    // Number of pattern instances on the board
+    static const int INSTANCES = 34;
+    // Most instances any one square belongs to
+    static const int MAX_PER_SQUARE = 8;
+    // Game stages, by number of discs
+    static const int STAGES = 15;
+    // Weights are stored in 1/SCALE units of the evaluation
+    static const int SCALE = 8;
+    // Trained weights evaluate in 1/UNITS_PER_DISC of a disc
+    static const int UNITS_PER_DISC = 4;
+
+    /*
+     * An instance a square belongs to, and the power of three of the
+     * square's digit in that instance's index.
+     */
+    struct Feature {
+        uint8_t instance;
+        uint16_t power;
+    };
+
+    // Weight of a stable stone in the seeded weights
+    static const int SEED_STABILITY = 10;
+
+    /*
+     * A full set of weights: the pattern tables, the mobility weight (for
+     * a Board::mobility of 100) and the weight of a stable stone of every
+     * stage. symmetric is set if the tables evaluate all eight symmetric
+     * images of a board the same (see isSymmetric).
+     */
+    struct WeightSet {
+        int16_t *weights[STAGES];
+        int16_t mobility[STAGES];
+        int16_t stability[STAGES];
+        bool symmetric;
+    };
+
+    static void init();
+    static void index(uint64_t black, uint64_t white, uint16_t indices[]);
+    static int evaluate(const uint16_t indices[], int discs,
+            const WeightSet &set = standard);
+    static double mobilityTerm(double mobility, int discs,
+            const WeightSet &set = standard);
+    static double stabilityTerm(int stability, int discs,
+            const WeightSet &set = standard);
+
+    static int symmetricIndex(int type, int index, int symmetry);
+    static bool isSymmetric(const WeightSet &set);
+
+    static WeightSet *copyWeights(const WeightSet &from);
+    static bool load(const char *filename, WeightSet &set = standard);
+    static bool save(const char *filename, const WeightSet &set = standard);
+
+    static int stage(int discs);
+
+    // Features of each square, terminated by an instance of INSTANCES
+    static Feature features[64][MAX_PER_SQUARE + 1];
+
+    // Type of each instance and the offset of its table in a stage's
+    // weights, and the offset and size of each type's table
+    static int instance_type[INSTANCES];
+    static int instance_offset[INSTANCES];
+    static int type_offset[TYPES + 1];
+    static int type_size[TYPES];
+
+    // Weights evaluated with unless a player is given others
+    static WeightSet standard;
+
+    // Default weights file
+    static const char *const WEIGHTS_FILE;
+
+private:
+    static bool initialized;
+    static void allocate(WeightSet &set);
+    static void seedWeights();
+};
+
+#endif
@@ -1,4 +1,9 @@
 #include "player.h"
+#include <math.h>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
 
 /*
  * Constructor for the player; initialize everything here. The side your AI is
@@ -10,179 +15,901 @@ Player::Player(Side side) {
     testingMinimax = false;
 	player_side = side;
 	board = new Board();
+    search_depth = DEPTH;
+    endgame_depth = DEPTH_ENDGAME;
+    move_time = 0;
+    node_limit = 0;
+    weights = &Patterns::standard;
+    selectivity = SELECTIVITY_TENTHS / 10.0;
+    probcut = &ProbCut::standard;
+    tt = new TranspositionTable();
+    book = NULL;
+    solved = NULL;
+    log_search = false;
+    timed = false;
+    stopped = false;
+    memset(&stats, 0, sizeof(stats));
+    memset(killers, NO_MOVE, sizeof(killers));
+    memset(history, 0, sizeof(history));
+
+    master = NULL;
+    threads = 1;
+    helpers = NULL;
+    helper_threads = NULL;
+    helpers_stop = 0;
+    first_depth = 1;
+    stop_requested = 0;
+    pondering = false;
+}
+
+/*
+ * Constructor for the index-th helper of a master player. It shares the
+ * master's transposition table and searches whatever the master gives it.
+ * Every other helper starts iterative deepening one ply deeper, so the
+ * threads spread out over depths.
+ */
+Player::Player(Player *master, int index) {
+    testingMinimax = false;
+    player_side = master->player_side;
+    board = NULL;
+    search_depth = master->search_depth;
+    endgame_depth = master->endgame_depth;
+    move_time = 0;
+    node_limit = 0;
+    weights = master->weights;
+    selectivity = master->selectivity;
+    probcut = master->probcut;
+    tt = master->tt;
+    book = NULL;
+    solved = master->solved;
+    log_search = false;
+    timed = false;
+    stopped = false;
+    memset(&stats, 0, sizeof(stats));
+    memset(killers, NO_MOVE, sizeof(killers));
+    memset(history, 0, sizeof(history));
+
+    this->master = master;
+    threads = 1;
+    helpers = NULL;
+    helper_threads = NULL;
+    helpers_stop = 0;
+    first_depth = 1 + index % 2;
+    stop_requested = 0;
+    pondering = false;
 }
 
 /*
  * Destructor for the player.
  */
 Player::~Player() {
-} 
+    stopPondering();
+    setThreads(1);
+    if (master == NULL) {
+        delete tt;
+    }
+}
+
+/**
+ * Sets how many threads search each move. With one thread, searches are
+ * deterministic.
+ */
+void Player::setThreads(int count) {
+    for (int i = 0; i < threads - 1; i++) {
+        delete helpers[i];
+    }
+    delete[] helpers;
+    delete[] helper_threads;
+    helpers = NULL;
+    helper_threads = NULL;
+
+    threads = (count > 1) ? count : 1;
+    if (threads > 1) {
+        helpers = new Player *[threads - 1];
+        helper_threads = new pthread_t[threads - 1];
+        for (int i = 0; i < threads - 1; i++) {
+            helpers[i] = new Player(this, i + 1);
+        }
+    }
+}
+
+/**
+ * Nodes searched in the last search by this player and its helpers.
+ */
+unsigned long Player::totalNodes() const {
+    unsigned long nodes = stats.nodes;
+    for (int i = 0; i < threads - 1; i++) {
+        nodes += helpers[i]->stats.nodes;
+    }
+    return nodes;
+}
+
+/**
+ * Statistics of the last search by this player and its helpers, summed.
+ */
+SearchStats Player::totalStats() const {
+    SearchStats total = stats;
+    for (int i = 0; i < threads - 1; i++) {
+        total.add(helpers[i]->stats);
+    }
+    return total;
+}
 
 /**
-Returns the maximal score of the board, and modifies best_move to contain 
-the move that will reach that score. (best_move is dynamically allocated; 
-please free with delete.) Uses minimax of the specified depth, where the
-to-be-optimized player is on the specified side. 
+ * Follows the best moves stored in the transposition table from the given
+ * position, and puts their squares in pv (NO_MOVE for a pass). Returns how
+ * many there are. The line ends at the first position without a legal
+ * stored move, so it may be shorter than the search was deep.
+ */
+int Player::principalVariation(const Board &board, Side side, int pv[])
+        const {
+    Board position = board;
+    int length = 0;
+    while (length < 64) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        uint64_t moves = position.moveMask(side);
+        if (moves == 0) {
+            if (position.moveMask(other) == 0 || length == 0
+                    || pv[length - 1] == NO_MOVE) {
+                break;
+            }
+            pv[length++] = NO_MOVE;
+            side = other;
+            continue;
+        }
+        int move = storedMove(position, side);
+        if (move == NO_MOVE) {
+            break;
+        }
+        pv[length++] = move;
+        position.doMove(move, side);
+        side = other;
+    }
+    // A trailing pass is not part of the line
+    if (length > 0 && pv[length - 1] == NO_MOVE) {
+        length--;
+    }
+    return length;
+}
+
+/**
+ * Writes the statistics of the search that chose move on the board to
+ * stderr, as one line of JSON. Squares are written as in "f5", a pass as
+ * "pass".
+ */
+void Player::logSearch(const Board &board, int move, bool pondered) const {
+    SearchStats total = totalStats();
+    int pv[64];
+    int length = principalVariation(board, player_side, pv);
+
+    std::ostringstream line;
+    line << "{\"discs\":" << board.countAll()
+        << ",\"side\":\"" << (player_side == BLACK ? "black" : "white")
+        << "\",\"move\":\"";
+    if (move == NO_MOVE) {
+        line << "pass";
+    } else {
+        line << (char) ('a' + move % 8) << (char) ('1' + move / 8);
+    }
+    line << "\",\"book\":" << (total.book ? "true" : "false")
+        << ",\"pondered\":" << (pondered ? "true" : "false")
+        << ",\"depth\":" << total.depth
+        << ",\"score\":" << total.score
+        << ",\"exact\":" << (total.exact ? "true" : "false")
+        << ",\"nodes\":" << total.nodes
+        << ",\"leaf_evaluations\":" << total.leaf_evaluations
+        << ",\"cutoffs\":" << total.cutoffs
+        << ",\"first_move_cutoff_rate\":"
+        << (total.cutoffs == 0 ? 0.0
+                : (double) total.first_move_cutoffs / total.cutoffs)
+        << ",\"tt_probes\":" << total.tt_probes
+        << ",\"tt_hits\":" << total.tt_hits
+        << ",\"probcuts\":" << total.probcuts
+        << ",\"solved_hits\":" << total.solved_hits
+        << ",\"time_ms\":" << total.time_ms
+        << ",\"budget_ms\":" << total.budget_ms
+        << ",\"threads\":" << threads
+        << ",\"pv\":[";
+    for (int i = 0; i < length; i++) {
+        line << (i > 0 ? ",\"" : "\"");
+        if (pv[i] == NO_MOVE) {
+            line << "pass";
+        } else {
+            line << (char) ('a' + pv[i] % 8) << (char) ('1' + pv[i] / 8);
+        }
+        line << "\"";
+    }
+    line << "]}\n";
+    cerr << line.str();
+    cerr.flush();
+}
+
+/**
+ * Asks the search running on another thread to stop as soon as it can. It
+ * returns what it would have returned had it run out of time.
+ */
+void Player::stop() {
+    __atomic_store_n(&stop_requested, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes back a stop() once the search it was meant for has returned, so
+ * the next one runs in full.
+ */
+void Player::clearStop() {
+    stop_requested = 0;
+}
+
+/**
+ * Forgets what earlier searches learned: the transposition table, and the
+ * killer moves and history scores of every thread. The next search then
+ * depends only on its position.
+ */
+void Player::clearSearch() {
+    tt->clear();
+    memset(killers, NO_MOVE, sizeof(killers));
+    memset(history, 0, sizeof(history));
+    for (int i = 0; i < threads - 1; i++) {
+        memset(helpers[i]->killers, NO_MOVE, sizeof(helpers[i]->killers));
+        memset(helpers[i]->history, 0, sizeof(helpers[i]->history));
+    }
+}
+
+/**
+ * Starts pondering on the position on our board, where the opponent is to
+ * move after our reply. If our search stored a best reply for the opponent,
+ * the thread searches our move after it; otherwise it searches the
+ * opponent's position, which fills the transposition table for any reply.
+ */
+void Player::startPondering() {
+    stopPondering();
+    Side opponent_side = (player_side == BLACK) ? WHITE : BLACK;
+    uint64_t replies = board->moveMask(opponent_side);
+    ponder_board = *board;
+    ponder_reply = NO_MOVE;
+    if (replies != 0) {
+        int reply = storedMove(*board, opponent_side);
+        if (reply != NO_MOVE) {
+            ponder_reply = reply;
+            ponder_board.doMove(ponder_reply, opponent_side);
+            ponder_side = player_side;
+        } else {
+            ponder_side = opponent_side;
+        }
+    } else if (board->moveMask(player_side) != 0) {
+        // The opponent has to pass
+        ponder_side = player_side;
+    } else {
+        return;
+    }
 
-If depth = 0 or there are no legal moves, the board's heuristic score is 
-returned, and best_move is NULL and does NOT need to be deleted.
+    stop_requested = 0;
+    ponder_done = 0;
+    pondering = true;
+    pthread_create(&ponder_thread, NULL, runPonder, this);
+}
+
+/**
+ * Stops pondering, if it is going on, and waits for the thread to finish.
+ */
+void Player::stopPondering() {
+    if (!pondering) {
+        return;
+    }
+    stop();
+    pthread_join(ponder_thread, NULL);
+    stop_requested = 0;
+    pondering = false;
+}
+
+/**
+ * Thread body of pondering: searches until stopped, then leaves the move
+ * found in ponder_move.
+ */
+void *Player::runPonder(void *player) {
+    Player *self = (Player *) player;
+    self->ponder_move = self->findMove(self->ponder_board, self->ponder_side,
+            UNTIL_STOPPED);
+    __atomic_store_n(&self->ponder_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * Ends pondering once the opponent has played opponents_move (NO_MOVE for a
+ * pass). If that was the reply pondered on and we are on a clock, the
+ * search is given this move's time budget to finish, and its move is put in
+ * best_move. Returns false if there is no move from pondering, and the
+ * search has to be done now.
+ */
+bool Player::finishPondering(int opponents_move, int msLeft,
+        int &best_move) {
+    if (!pondering) {
+        return false;
+    }
+    bool hit = ponder_side == player_side && opponents_move == ponder_reply
+        && msLeft >= 0 && !testingMinimax;
+    if (hit) {
+        long wait_until = currentTimeMs()
+            + timeBudget(msLeft, 64 - ponder_board.countAll());
+        while (!__atomic_load_n(&ponder_done, __ATOMIC_ACQUIRE)
+                && currentTimeMs() < wait_until) {
+            usleep(1000);
+        }
+    }
+    stopPondering();
+    best_move = ponder_move;
+    return hit && best_move != NO_MOVE;
+}
+
+/**
+ * Sets the helpers searching the board, from root_side's point of view:
+ * solving the endgame, or with iterative deepening up to max_depth.
+ */
+void Player::startHelpers(const Board &board, bool endgame, int max_depth) {
+    helpers_stop = 0;
+    for (int i = 0; i < threads - 1; i++) {
+        Player *helper = helpers[i];
+        helper->root_side = root_side;
+        helper->search_depth = search_depth;
+        helper->endgame_depth = endgame_depth;
+        helper->weights = weights;
+        helper->selectivity = selectivity;
+        helper->probcut = probcut;
+        helper->solved = solved;
+        helper->helper_board = board;
+        helper->helper_endgame = endgame;
+        helper->helper_max_depth = max_depth;
+        pthread_create(&helper_threads[i], NULL, runHelper, helper);
+    }
+}
+
+/**
+ * Tells the helpers to stop, and waits for them.
+ */
+void Player::stopHelpers() {
+    __atomic_store_n(&helpers_stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < threads - 1; i++) {
+        pthread_join(helper_threads[i], NULL);
+    }
+}
+
+/**
+ * Thread body of a helper: searches what startHelpers gave it until done
+ * or stopped. Its results only reach the master through the shared
+ * transposition table.
+ */
+void *Player::runHelper(void *helper) {
+    Player *player = (Player *) helper;
+    memset(player->killers, NO_MOVE, sizeof(player->killers));
+    player->startClock(false, 0);
+    if (player->helper_endgame) {
+        player->solveEndgame(player->helper_board);
+    } else {
+        player->iterativeDeepening(player->helper_board,
+                player->helper_max_depth, 0);
+    }
+    return NULL;
+}
+
+/**
+Returns the maximal score of the board, and sets best_move to the square
+(x + 8 * y) of the move that will reach that score. Uses minimax of the
+specified depth, where the to-be-optimized player is on the specified side.
+Child boards are copies on the stack, so the search never allocates.
+
+Results are kept in the transposition table: a stored search that is at
+least as deep may answer the call outright or narrow the window. Moves are
+searched in the order given by orderMoves, starting with the stored best
+move.
+
+If depth = 0 or the game is over, the board's heuristic score is returned,
+and best_move is NO_MOVE. If the side to move has no legal moves, it passes
+and best_move is NO_MOVE as well.
+
+If the clock set by startClock runs out, the search unwinds right away and
+sets stopped; the score and best_move are then meaningless.
+*/
+int Player::minimax(const Board &board, Side side, int depth, int lower_bound,
+        int upper_bound, int &best_move) {
+    if (upper_bound - lower_bound == 1) {
+        return search<NULL_WINDOW_NODE>(board, side, depth, lower_bound,
+                upper_bound, best_move);
+    }
+    return search<PV_NODE>(board, side, depth, lower_bound, upper_bound,
+            best_move);
+}
+
+/**
+The body of minimax, compiled once for each type of node so neither has to
+test for the other. A PV_NODE is searched with an open window, its first
+move as a PV_NODE too and the others with a null window, searched again in
+full if that fails high. A NULL_WINDOW_NODE only has to tell whether the
+score is above lower_bound, so all its moves get the same null window and
+are never searched again, and Multi-ProbCut may prune it.
 */
-int Player::minimax(Board *board, Side side, int depth, int lower_bound, 
-        int upper_bound, Move *&best_move) {
-    best_move = NULL;
-    
+template <Player::NodeType NODE>
+int Player::search(const Board &board, Side side, int depth, int lower_bound,
+        int upper_bound, int &best_move) {
+    best_move = NO_MOVE;
+    if (outOfTime()) {
+        return 0;
+    }
+
+    uint64_t moves = board.moveMask(side);
     if (depth == 0) {
-        // Base case: return score from the perspective of "side"
-        return board->score(side);
+        // Base case: return score from the perspective of "side", reusing
+        // the move mask for its mobility term
+        stats.leaf_evaluations++;
+        return board.score(side, moves, *weights);
     }
 
     int best_score = -1000000;
     int new_score;
-    Move *new_move, *garbage;
-    Board *new_board;
-    
+    int garbage;
+
     Side otherSide = side == BLACK ? WHITE : BLACK;
-    
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            new_move = new Move(i, j);
-            new_board = board->doMoveIfLegal(new_move, side);
-            
-            if (new_board != NULL) {
-                // Legal move
-                             
-                // Find heuristic score of new_board, using recursive minimax
-                new_score = -minimax(new_board, otherSide, depth - 1, 
-                        -upper_bound, -lower_bound, garbage);
-                if (garbage != NULL) {
-                    delete garbage;
-                }
-                
-                // cerr << endl << "---------------" << endl;
-                // cerr << "In minimax: LEGAL move: x y " << new_move->getX() << " " << new_move->getY() << endl;
-                // cerr << "Resulting score: " << new_min_score << endl;
-                // cerr << "Resulting board:" << endl;
-                // newBoard->printboard();
-                
-                if (new_score > best_score) { 
-                    // Best score so far; update best_score and best_move
-                    // cerr << "Preceding move updated as BEST!" << endl;
-                    
-                    best_score = new_score;
-                    if (best_move != NULL) {
-                        delete best_move;
-                    }
-                    best_move = new_move;
-                    
-                } else {
-                    // This move wasn't the best so far, delete it
-                    delete new_move;
-                }
-
-                // lower_bound = max(lower_bound, new_score)
-                if (new_score > lower_bound) {
-                    lower_bound = new_score;
-                }
-
-                
-            } else {
-                // This move wasn't legal, delete it
-                delete new_move;
-            }
 
-            if (lower_bound >= upper_bound) { 
-                return best_score;
-            }
-            
-            delete new_board;
+    if (moves == 0) {
+        if (board.moveMask(otherSide) == 0) {
+            // Neither side can move: the game is over
+            stats.leaf_evaluations++;
+            return board.score(side, moves, *weights);
+        }
+        // Pass; the opponent moves again from the same board
+        return -search<NODE>(board, otherSide, depth, -upper_bound,
+                -lower_bound, garbage);
+    }
+
+    int symmetry;
+    uint64_t key = positionKey(board, side, symmetry);
+    int hash_move = probe(key, moves, depth, lower_bound, upper_bound,
+            best_score, symmetry);
+    if (best_score != -1000000) {
+        best_move = hash_move;
+        return best_score;
+    }
+    int original_lower_bound = lower_bound;
+
+    // Multi-ProbCut, in null windows only: the PV is searched in full
+    if (NODE == NULL_WINDOW_NODE && selectivity > 0) {
+        int cut_score;
+        bool cut = probCut(board, side, depth, lower_bound, cut_score);
+        if (stopped) {
+            return 0;
+        }
+        if (cut) {
+            stats.probcuts++;
+            return cut_score;
         }
     }
-    
-    if (best_move == NULL) { 
-        //There were no legal moves
-        return board->score(side);
+
+    int move_list[MAX_MOVES];
+    int move_count = orderMoves(board, side, moves, hash_move, depth,
+            move_list);
+    for (int i = 0; i < move_count; i++) {
+        int square = move_list[i];
+
+        Board new_board = board;
+        new_board.doMove(square, side);
+
+        // Find heuristic score of new_board, using recursive minimax
+        // Principal variation search: the first move gets the full window.
+        // The others only have to be proven worse than the best so far with
+        // a null window, and are searched again if that fails.
+        if (NODE == NULL_WINDOW_NODE) {
+            new_score = -search<NULL_WINDOW_NODE>(new_board, otherSide,
+                    depth - 1, -upper_bound, -lower_bound, garbage);
+        } else if (i == 0) {
+            new_score = -search<PV_NODE>(new_board, otherSide, depth - 1,
+                    -upper_bound, -lower_bound, garbage);
+        } else {
+            new_score = -search<NULL_WINDOW_NODE>(new_board, otherSide,
+                    depth - 1, -lower_bound - 1, -lower_bound, garbage);
+            if (new_score > lower_bound && new_score < upper_bound
+                    && !stopped) {
+                new_score = -search<PV_NODE>(new_board, otherSide,
+                        depth - 1, -upper_bound, -lower_bound, garbage);
+            }
+        }
+        if (stopped) {
+            return 0;
+        }
+
+        if (new_score > best_score) {
+            // Best score so far; update best_score and best_move
+            best_score = new_score;
+            best_move = square;
+        }
+
+        // lower_bound = max(lower_bound, new_score)
+        if (new_score > lower_bound) {
+            lower_bound = new_score;
+        }
+
+        if (lower_bound >= upper_bound) {
+            recordCutoff(board, side, square, depth, i);
+            break;
+        }
     }
-    
+
+    store(key, depth, original_lower_bound, upper_bound, best_score,
+            best_move, symmetry);
     return best_score;
 }
 
 /**
-Returns the maximal score of the board, and modifies best_move to contain 
-the move that will reach that score. (best_move is dynamically allocated; 
-please free with delete.) Uses minimax of the specified depth, where the
-to-be-optimized player is on the specified side. 
+Searches the board with minimax at increasing depths, up to max_depth, and
+returns the best move of the deepest search that finished. Each depth after
+the first is searched with an aspiration window around the score of the one
+before. When playing on a clock, no new depth is started after soft_limit
+milliseconds, and a depth cut short by the hard deadline is thrown away.
+Falls back to any legal move if not even the first depth finished, and
+returns NO_MOVE if there is none.
+*/
+int Player::iterativeDeepening(const Board &board, int max_depth,
+        long soft_limit) {
+    int best_move = NO_MOVE;
+    int score = 0;
+    for (int depth = first_depth; depth <= max_depth; depth++) {
+        unsigned long nodes_before = stats.nodes;
+        int move;
+        if (depth == first_depth) {
+            score = minimax(board, root_side, depth, -1000000, +1000000,
+                    move);
+        } else {
+            score = aspirationSearch(board, depth, score, ASPIRATION_WINDOW,
+                    move);
+        }
+        if (stopped) {
+            break;
+        }
+        best_move = move;
+        stats.depth = depth;
+        stats.score = score;
+        stats.previous_iteration_nodes = stats.last_iteration_nodes;
+        stats.last_iteration_nodes = stats.nodes - nodes_before;
+        if (timed && currentTimeMs() - search_start >= soft_limit) {
+            break;
+        }
+    }
+
+    uint64_t moves = board.moveMask(root_side);
+    if (best_move == NO_MOVE && moves != 0) {
+        best_move = firstSquare(moves);
+    }
+    return best_move;
+}
 
-If depth = 0 or there are no legal moves, the board's heuristic score is 
-returned, and best_move is NULL and does NOT need to be deleted.
+/**
+Searches the board to the given depth, or to the end of the game if depth is
+ENDGAME, with a window of the given half-width around an expected score.
+Whenever the score falls outside the window, the window is widened on that
+side, twice as far each time, and searched again; after ASPIRATION_TRIES
+failures the full window is used. Returns the score, and sets best_move.
 */
-int Player::minimax_endgame(Board *board, Side side, int lower_bound, 
-        int upper_bound, Move *&best_move) {
-    best_move = NULL;
-    int best_score = -1000000;
-    int new_score;
-    Move *new_move, *garbage;
-    Board *new_board;
+int Player::aspirationSearch(const Board &board, int depth, int guess,
+        int window, int &best_move) {
+    int lower_bound = guess - window;
+    int upper_bound = guess + window;
+    for (int tries = 0; ; tries++) {
+        if (tries == ASPIRATION_TRIES) {
+            lower_bound = -1000000;
+            upper_bound = +1000000;
+        }
+
+        int score;
+        if (depth == ENDGAME) {
+            score = minimax_endgame(board, root_side, lower_bound,
+                    upper_bound, best_move);
+        } else {
+            score = minimax(board, root_side, depth, lower_bound,
+                    upper_bound, best_move);
+        }
+        if (stopped) {
+            return 0;
+        }
+
+        window *= 2;
+        if (score <= lower_bound && lower_bound > -1000000) {
+            lower_bound = score - window;
+        } else if (score >= upper_bound && upper_bound < +1000000) {
+            upper_bound = score + window;
+        } else {
+            return score;
+        }
+    }
+}
+
+/**
+Returns how many milliseconds to budget for this move, given the time left
+for the game and the number of empty squares. The time is split evenly over
+our remaining midgame moves, with ENDGAME_SHARE moves' worth held back for
+the endgame solver, which then gets a large slice of what is left.
+*/
+int Player::timeBudget(int msLeft, int empties) {
+    int usable = msLeft - TIME_RESERVE;
+    int moves;
+    if (empties > endgame_depth) {
+        moves = (empties - endgame_depth + 1) / 2 + ENDGAME_SHARE;
+    } else {
+        moves = 1 + empties / 8;
+    }
+    return (usable > moves) ? usable / moves : 1;
+}
 
+/**
+Starts the clock for a search. If timed is false, searches run until done;
+otherwise they stop hard_limit milliseconds from now.
+*/
+void Player::startClock(bool timed, long hard_limit) {
+    this->timed = timed;
+    search_start = currentTimeMs();
+    deadline = search_start + hard_limit;
+    stopped = false;
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**
+Counts a node, and returns whether the search has to stop. The clock, the
+node limit, and for a helper whether its master is done, are only checked
+every CLOCK_INTERVAL nodes, so it costs next to nothing.
+*/
+bool Player::outOfTime() {
+    stats.nodes++;
+    if ((stats.nodes % CLOCK_INTERVAL) == 0) {
+        if (timed && currentTimeMs() >= deadline) {
+            stopped = true;
+        }
+        if (node_limit > 0 && stats.nodes >= node_limit) {
+            stopped = true;
+        }
+        if (master != NULL
+                && __atomic_load_n(&master->helpers_stop, __ATOMIC_RELAXED)) {
+            stopped = true;
+        }
+        if (__atomic_load_n(&stop_requested, __ATOMIC_RELAXED)) {
+            stopped = true;
+        }
+    }
+    return stopped;
+}
+
+/**
+Wall clock time in milliseconds.
+*/
+long Player::currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+/**
+Multi-ProbCut test of a null window search [lower_bound, lower_bound + 1]
+at the given depth. A shallow search predicts the deep score; if the
+prediction is more than selectivity standard deviations of its error above
+or below the window, returns true and sets score to the bound it fails on.
+*/
+bool Player::probCut(const Board &board, Side side, int depth,
+        int lower_bound, int &score) {
+    const ProbCut::Params *p = ProbCut::lookup(board.countAll(), depth,
+            *probcut);
+    if (p == NULL) {
+        return false;
+    }
+    double margin = selectivity * p->sigma;
+    int garbage;
+
+    int high = (int) ceil((lower_bound + 1 + margin - p->b) / p->a);
+    if (search<NULL_WINDOW_NODE>(board, side, p->shallow, high - 1, high,
+                garbage) >= high) {
+        score = lower_bound + 1;
+        return !stopped;
+    }
+    int low = (int) floor((lower_bound - margin - p->b) / p->a);
+    if (search<NULL_WINDOW_NODE>(board, side, p->shallow, low, low + 1,
+                garbage) <= low) {
+        score = lower_bound;
+        return !stopped;
+    }
+    return false;
+}
+
+/**
+Returns the transposition table key of a midgame position with the given
+side to move. Early positions are keyed by their canonical form (see
+CANONICAL_DISCS), and symmetry is set to the transform giving it; it is
+0 otherwise. Moves are stored on the keyed form, so probe and store must
+be given the same symmetry. Symmetric boards only share entries if the
+weights evaluate them the same, which trained weights need not.
+*/
+uint64_t Player::positionKey(const Board &board, Side side,
+        int &symmetry) const {
+    if (weights->symmetric && board.countAll() <= CANONICAL_DISCS) {
+        return board.canonicalHash(side, symmetry);
+    }
+    symmetry = 0;
+    return board.hash(side);
+}
+
+/**
+Looks up a position in the transposition table. Returns its stored best
+move, mapped back through symmetry, if that move is among the given legal
+moves, and NO_MOVE otherwise. If the stored search was at least "depth"
+deep, its score bound is used to narrow [lower_bound, upper_bound]; when
+that settles the score, it is put in score, which is otherwise left alone.
+*/
+int Player::probe(uint64_t key, uint64_t moves, int depth, int &lower_bound,
+        int &upper_bound, int &score, int symmetry) {
+    TTEntry entry;
+    stats.tt_probes++;
+    if (!tt->probe(key, entry)) {
+        return NO_MOVE;
+    }
+    stats.tt_hits++;
+    if (entry.move != NO_MOVE) {
+        entry.move = Board::untransformSquare(entry.move, symmetry);
+    }
+    if (entry.move == NO_MOVE || !(moves & squareBit(entry.move))) {
+        // A hash collision, or a position whose best move was not recorded
+        return NO_MOVE;
+    }
+
+    if (entry.depth >= depth) {
+        if (entry.bound == BOUND_EXACT) {
+            score = entry.score;
+        } else if (entry.bound == BOUND_LOWER && entry.score > lower_bound) {
+            lower_bound = entry.score;
+        } else if (entry.bound == BOUND_UPPER && entry.score < upper_bound) {
+            upper_bound = entry.score;
+        }
+        if (lower_bound >= upper_bound) {
+            score = entry.score;
+        }
+    }
+    return entry.move;
+}
+
+/**
+Stores the result of searching a position with the window
+[lower_bound, upper_bound] in the transposition table, with the best move
+mapped through symmetry.
+*/
+void Player::store(uint64_t key, int depth, int lower_bound, int upper_bound,
+        int score, int best_move, int symmetry) {
+    Bound bound = BOUND_EXACT;
+    if (score <= lower_bound) {
+        bound = BOUND_UPPER;
+    } else if (score >= upper_bound) {
+        bound = BOUND_LOWER;
+    }
+    if (best_move != NO_MOVE) {
+        best_move = Board::transformSquare(best_move, symmetry);
+    }
+    tt->store(key, depth, bound, score, best_move);
+}
+
+/**
+Returns the best move stored in the transposition table for the position
+with the given side to move, preferring an endgame solve to a midgame
+search, or NO_MOVE if there is none or it is not legal there.
+*/
+int Player::storedMove(const Board &board, Side side) const {
+    TTEntry entry;
+    int symmetry = 0;
+    if (!tt->probe(board.hash(side) ^ ENDGAME_KEY, entry)
+            && !tt->probe(positionKey(board, side, symmetry), entry)) {
+        return NO_MOVE;
+    }
+    if (entry.move == NO_MOVE) {
+        return NO_MOVE;
+    }
+    int move = Board::untransformSquare(entry.move, symmetry);
+    return (board.moveMask(side) & squareBit(move)) ? move : NO_MOVE;
+}
+
+/**
+Fills move_list with the squares of the given legal moves, best candidates
+first, and returns how many there are. The stored hash move goes first and
+the killer moves for this number of discs next. The rest are ranked by
+history score and square value, and, far enough from the leaves, by how few
+replies they leave the opponent.
+*/
+int Player::orderMoves(const Board &board, Side side, uint64_t moves,
+        int hash_move, int depth, int move_list[]) {
     Side otherSide = side == BLACK ? WHITE : BLACK;
+    uint64_t own = board.pieces(side);
+    uint64_t opp = board.pieces(otherSide);
+    int discs = board.countAll();
+    int keys[MAX_MOVES];
+    int count = 0;
 
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            new_move = new Move(i, j);
-            new_board = board->doMoveIfLegal(new_move, side);
-
-            if (new_board != NULL) {
-                // Legal move
-
-                // Find heuristic score of new_board, using recursive minimax
-                new_score = -minimax_endgame(new_board, otherSide, -upper_bound, 
-                        -lower_bound, garbage);
-                if (garbage != NULL) {
-                    delete garbage;
-                }
-
-                if (new_score > best_score) { 
-                    // Best score so far; update best_score and best_move
-                    // cerr << "Preceding move updated as BEST!" << endl;
-
-                    best_score = new_score;
-                    if (best_move != NULL) {
-                        delete best_move;
-                    }
-                    best_move = new_move;
-
-                } else {
-                    // This move wasn't the best so far, delete it
-                    delete new_move;
-                }
-
-                // lower_bound = max(lower_bound, new_score)
-                if (new_score > lower_bound) {
-                    lower_bound = new_score;
-                }
-
-
-            } else {
-                // This move wasn't legal, delete it
-                delete new_move;
-            }
+    while (moves) {
+        int square = firstSquare(moves);
+        moves &= moves - 1;
 
-            if (lower_bound >= upper_bound) { 
-                return best_score;
+        int key;
+        if (square == hash_move) {
+            key = 1 << 30;
+        } else if (square == killers[discs][0]) {
+            key = 1 << 29;
+        } else if (square == killers[discs][1]) {
+            key = 1 << 28;
+        } else {
+            key = Board::heuristic_values[square] + history[side][square];
+            if (depth >= MOBILITY_ORDER_DEPTH) {
+                uint64_t flips = Board::flipMask(own, opp, square);
+                key -= bitCount(Board::legalMoves(opp ^ flips,
+                        own ^ flips ^ squareBit(square)))
+                        * MOBILITY_ORDER_WEIGHT;
             }
+        }
 
-            delete new_board;
+        // Insertion sort, best key first
+        int i = count++;
+        while (i > 0 && keys[i - 1] < key) {
+            keys[i] = keys[i - 1];
+            move_list[i] = move_list[i - 1];
+            i--;
         }
+        keys[i] = key;
+        move_list[i] = square;
     }
+    stats.moves_generated += count;
+    return count;
+}
 
-    if (best_move == NULL) { 
-        //There were no legal moves. Maybe the board was full
-        return board->score_endgame(side);
+/**
+Notes that searching the given move, the index-th one tried, caused a beta
+cutoff: counts it, makes it a killer move and raises its history score so
+it is tried earlier next time.
+*/
+void Player::recordCutoff(const Board &board, Side side, int square,
+        int depth, int index) {
+    stats.cutoffs++;
+    if (index == 0) {
+        stats.first_move_cutoffs++;
     }
 
-    return best_score;
+    int discs = board.countAll();
+    if (killers[discs][0] != square) {
+        killers[discs][1] = killers[discs][0];
+        killers[discs][0] = square;
+    }
+    history[side][square] += depth * depth;
+    if (history[side][square] > HISTORY_LIMIT) {
+        for (int i = 0; i < 64; i++) {
+            history[WHITE][i] /= 2;
+            history[BLACK][i] /= 2;
+        }
+    }
 }
 
+/**
+Effective branching factor of the last two iterations of iterativeDeepening:
+how many times more nodes the deepest one took than the one before it.
+*/
+double SearchStats::branchingFactor() const {
+    if (previous_iteration_nodes == 0) {
+        return 0;
+    }
+    return (double) last_iteration_nodes / previous_iteration_nodes;
+}
 
+/**
+ * Adds the counters of another thread's search to these. The depth, score
+ * and timing are left as they are.
+ */
+void SearchStats::add(const SearchStats &other) {
+    nodes += other.nodes;
+    moves_generated += other.moves_generated;
+    cutoffs += other.cutoffs;
+    first_move_cutoffs += other.first_move_cutoffs;
+    leaf_evaluations += other.leaf_evaluations;
+    tt_probes += other.tt_probes;
+    tt_hits += other.tt_hits;
+    probcuts += other.probcuts;
+    solved_hits += other.solved_hits;
+}
 
 /*
  * Compute the next move given the opponent's last move. Your AI is
@@ -201,18 +928,109 @@ Move *Player::doMove(Move *opponentsMove, int msLeft) {
 
 	// Update the board with opponent's move
 	board->doMove(opponentsMove, opponent_side);
-    
-    // Find best move, and update our board with it
-    Move *best_move;
-    if (64 - board->countAll() <= DEPTH_ENDGAME) {
+
+    // Find best move, unless pondering found it already, and update our
+    // board with it
+    int opponents_square = (opponentsMove == NULL) ? NO_MOVE
+        : opponentsMove->getX() + 8 * opponentsMove->getY();
+    int best_move;
+    long start = currentTimeMs();
+    bool pondered = finishPondering(opponents_square, msLeft, best_move);
+    if (!pondered) {
+        // Time spent waiting on pondering has come off the clock too
+        if (msLeft >= 0) {
+            msLeft -= (int) (currentTimeMs() - start);
+            if (msLeft < 0) {
+                msLeft = 0;
+            }
+        }
+        best_move = findMove(*board, player_side, msLeft);
+    }
+    if (log_search) {
+        logSearch(*board, best_move, pondered);
+    }
+    if (best_move == NO_MOVE) {
+        return NULL;
+    }
+    board->doMove(best_move, player_side);
+
+    return new Move(best_move % 8, best_move / 8);
+}
+
+/*
+ * Returns the square of the best move for the given side on the board, or
+ * NO_MOVE if it has to pass. msLeft is the time left for the game as in
+ * doMove. On a clock, searches as deep as the time budget for this move
+ * allows; otherwise searches to search_depth, or solves the endgame once
+ * there are endgame_depth empty squares left. With msLeft UNTIL_STOPPED,
+ * searches ever deeper until stop() is called.
+ */
+int Player::findMove(const Board &board, Side side, int msLeft) {
+    int book_move, book_score;
+    if (book != NULL && book->lookup(board, side, book_move, book_score)) {
+        // No search runs, so no helper counts any nodes either
+        memset(&stats, 0, sizeof(stats));
+        for (int i = 0; i < threads - 1; i++) {
+            memset(&helpers[i]->stats, 0, sizeof(helpers[i]->stats));
+        }
+        stats.score = book_score;
+        stats.book = true;
+        return book_move;
+    }
+    long start = currentTimeMs();
+
+    tt->newSearch();
+    memset(killers, NO_MOVE, sizeof(killers));
+    root_side = side;
+
+    int empties = 64 - board.countAll();
+    bool on_clock = (msLeft >= 0 || move_time > 0) && !testingMinimax;
+    int budget = 0;
+    if (on_clock) {
+        budget = (move_time > 0) ? move_time : timeBudget(msLeft, empties);
+    }
+    int best_move;
+    if (empties <= endgame_depth) {
         // Use endgame solver
-        int num_pieces = board->countAll();
-        cerr << num_pieces << " pieces on board; use endgame solver" << endl;
-        minimax_endgame(board, player_side, -1000000, +1000000, best_move);
+        startClock(on_clock, budget);
+        best_move = NO_MOVE;
+        if (on_clock) {
+            // Have a move ready in case the solver runs out of time
+            best_move = iterativeDeepening(board, empties, budget / 16);
+        } else if (msLeft == UNTIL_STOPPED) {
+            // Or in case it is stopped, as when pondering
+            int depth = (empties < FALLBACK_DEPTH) ? empties : FALLBACK_DEPTH;
+            best_move = iterativeDeepening(board, depth, 0);
+        }
+        startHelpers(board, true, 0);
+        int solved_move = solveEndgame(board);
+        if (solved_move != NO_MOVE) {
+            best_move = solved_move;
+        }
+        stopHelpers();
     } else {
-        minimax(board, player_side, DEPTH, -1000000, +1000000, best_move); 
+        int max_depth = search_depth;
+        if (on_clock) {
+            long hard_limit = 2L * budget;
+            if (move_time > 0) {
+                hard_limit = move_time;
+            } else if (hard_limit > (msLeft - TIME_RESERVE) / 4) {
+                hard_limit = (msLeft - TIME_RESERVE) / 4;
+            }
+            startClock(true, hard_limit);
+            max_depth = empties;
+        } else {
+            startClock(false, 0);
+            if (msLeft == UNTIL_STOPPED) {
+                max_depth = empties;
+            }
+        }
+        startHelpers(board, false, max_depth + 1);
+        best_move = iterativeDeepening(board, max_depth, budget / 2);
+        stopHelpers();
     }
-    board->doMove(best_move, player_side);
 
+    stats.time_ms = currentTimeMs() - start;
+    stats.budget_ms = budget;
     return best_move;
 }
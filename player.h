@@ -3,10 +3,54 @@
 
 #include <iostream>
 #include <stdlib.h>
+#include <pthread.h>
 #include "common.h"
 #include "board.h"
+#include "book.h"
+#include "probcut.h"
+#include "solved.h"
+#include "tt.h"
 using namespace std;
 
+/*
+ * Counters for the last search, for measuring how well it prunes.
+ */
+struct SearchStats {
+    unsigned long nodes;
+    unsigned long moves_generated;
+    unsigned long cutoffs;
+    // Cutoffs caused by the first move searched; with perfect move
+    // ordering, every cutoff would be one
+    unsigned long first_move_cutoffs;
+    // Deepest iteration of iterative deepening that finished, and the
+    // nodes it and the one before it took
+    int depth;
+    unsigned long last_iteration_nodes;
+    unsigned long previous_iteration_nodes;
+    // Score of the move found, for the side to move; exact if it is the
+    // final disc difference from the endgame solver
+    int score;
+    bool exact;
+    // Positions given to the evaluation function, and transposition table
+    // lookups and how many of them found their position
+    unsigned long leaf_evaluations;
+    unsigned long tt_probes;
+    unsigned long tt_hits;
+    // Wall time the search took, and the time budgeted for it (0 if it
+    // was not on a clock)
+    long time_ms;
+    long budget_ms;
+    // Set if the move came from the opening book, without a search
+    bool book;
+    // Nodes cut by Multi-ProbCut
+    unsigned long probcuts;
+    // Endgame positions found in the solved position cache
+    unsigned long solved_hits;
+
+    double branchingFactor() const;
+    void add(const SearchStats &other);
+};
+
 class Player {
 
 public:
@@ -21,18 +65,254 @@ public:
      * If there are only this many empty spaces on the board,
      * use complete endgame solver.
      */
-    static const int DEPTH_ENDGAME = 16;
+    static const int DEPTH_ENDGAME = 18;
+    /*
+     * Milliseconds of the game clock never budgeted for searching, to cover
+     * the time it takes to get moves to and from the game.
+     */
+    static const int TIME_RESERVE = 50;
+    /*
+     * How many midgame moves' worth of time to keep for the endgame solver.
+     */
+    static const int ENDGAME_SHARE = 4;
+    /*
+     * Depth of the search that gives an endgame solve with no clock, as
+     * when pondering, a move to fall back on if it is stopped early.
+     */
+    static const int FALLBACK_DEPTH = 4;
+    /*
+     * Nodes searched between reads of the clock.
+     */
+    static const int CLOCK_INTERVAL = 1024;
+    /*
+     * Most legal moves a position can have, with room to spare.
+     */
+    static const int MAX_MOVES = 64;
+    /*
+     * Midgame depth from which moves are also ordered by the opponent's
+     * mobility after them, and the weight of one reply in that ordering.
+     */
+    static const int MOBILITY_ORDER_DEPTH = 3;
+    static const int MOBILITY_ORDER_WEIGHT = 16;
+    /*
+     * History scores are halved when one gets this large.
+     */
+    static const int HISTORY_LIMIT = 1 << 20;
+    /*
+     * Endgame solver tuning. With at least ORDER_EMPTIES empty squares,
+     * positions go through the transposition table and moves are sorted by
+     * mobility; the last LAST_EMPTIES are solved by dedicated routines.
+     * Being in a quadrant with an odd number of empties is worth
+     * PARITY_ORDER_WEIGHT in the sort. Below STABILITY_MIN_ALPHA the
+     * opponent would need over 28 stable stones for a stability cutoff,
+     * which is too rare to be worth looking for.
+     */
+    static const int ORDER_EMPTIES = 7;
+    static const int LAST_EMPTIES = 4;
+    static const int PARITY_ORDER_WEIGHT = 8;
+    static const int STABILITY_MIN_ALPHA = 64 - 2 * 28;
+    /*
+     * Half-width of the first aspiration window around the expected score,
+     * in the midgame and in the endgame, and how many times it is widened
+     * before giving up and searching the full window.
+     */
+    static const int ASPIRATION_WINDOW = 20;
+    static const int ENDGAME_WINDOW = 4;
+    static const int ASPIRATION_TRIES = 3;
+    /*
+     * Multi-ProbCut confidence unless changed, in tenths of a standard
+     * deviation of the predicted score.
+     */
+    static const int SELECTIVITY_TENTHS = 15;
+    /*
+     * Positions with at most this many discs are stored in the
+     * transposition table under their canonical form, so the symmetric
+     * lines of the opening share entries, as long as the weights are
+     * symmetric. Later on symmetric positions are too rare to pay for
+     * finding it.
+     */
+    static const int CANONICAL_DISCS = 20;
+    /*
+     * Depth passed to aspirationSearch to solve to the end of the game.
+     */
+    static const int ENDGAME = -1;
     
+    /*
+     * Square index returned as best_move when there is no move to make.
+     */
+    static const int NO_MOVE = -1;
+    /*
+     * msLeft value telling findMove to search until stop() is called.
+     */
+    static const int UNTIL_STOPPED = -2;
+    /*
+     * Mixed into the hash of endgame positions so exact scores are stored
+     * apart from heuristic ones.
+     */
+    static const uint64_t ENDGAME_KEY = UINT64_C(0xD6E8FEB86659FD93);
+
     Move *doMove(Move *opponentsMove, int msLeft);
-    int minimax(Board *board, Side side, int depth, int lower_bound,
-            int upper_bound, Move *&best_move);
-    int minimax_endgame(Board *board, Side side, int lower_bound,
-            int upper_bound, Move *&best_move);
+    int findMove(const Board &board, Side side, int msLeft);
+    int minimax(const Board &board, Side side, int depth, int lower_bound,
+            int upper_bound, int &best_move);
+    int minimax_endgame(const Board &board, Side side, int lower_bound,
+            int upper_bound, int &best_move);
+
+    void setThreads(int count);
+    unsigned long totalNodes() const;
+    SearchStats totalStats() const;
+    int principalVariation(const Board &board, Side side, int pv[]) const;
+    void stop();
+    void clearStop();
+    void clearSearch();
+
+    void startPondering();
+    void stopPondering();
 
     // Flag to tell if the player is running within the test_minimax context
     bool testingMinimax;
     Side player_side;
     Board * board;
+    // Search settings, DEPTH and DEPTH_ENDGAME unless changed
+    int search_depth;
+    int endgame_depth;
+    // If positive, findMove searches each move for this many milliseconds
+    // instead of budgeting from the time left
+    int move_time;
+    // If positive, a search stops after about this many nodes on the main
+    // thread, as if it had run out of time
+    unsigned long node_limit;
+    // Evaluation weights, Patterns::standard unless changed
+    const Patterns::WeightSet *weights;
+    // How far outside the window, in standard deviations, a shallow search
+    // has to predict the score for Multi-ProbCut to prune; 0 turns it off
+    double selectivity;
+    // Multi-ProbCut parameters, fitted for weights; ProbCut::standard
+    // unless changed
+    const ProbCut::ParamSet *probcut;
+    // Number of threads searching each move; change with setThreads
+    int threads;
+    // Shared by both searches and all threads; resize() it to change the
+    // memory budget
+    TranspositionTable *tt;
+    // Opening book findMove plays from without searching, if not NULL
+    OpeningBook *book;
+    // Positions solved in earlier games, which the endgame solver looks up
+    // and adds its results to, if not NULL
+    SolvedCache *solved;
+    // If set, doMove writes the statistics of each search to stderr as a
+    // line of JSON
+    bool log_search;
+    SearchStats stats;
+
+private:
+    // Search clock, set by startClock
+    bool timed;
+    bool stopped;
+    long search_start;
+    long deadline;
+    Side root_side;
+
+    // Move ordering: two killer moves per number of discs on the board,
+    // and history scores per side and square
+    int killers[65][2];
+    int history[2][64];
+
+    // Endgame solver: doubly linked list of the empty squares, with its
+    // head at index 64, and a bit per quadrant with an odd number of them
+    int empty_next[65];
+    int empty_prev[65];
+    int parity;
+
+    // Lazy SMP: helper players search the same position on threads of
+    // their own, sharing the transposition table, until the main one is
+    // done. A helper has the main player as its master.
+    Player *master;
+    Player **helpers;
+    pthread_t *helper_threads;
+    int helpers_stop;
+    int first_depth;
+    Board helper_board;
+    bool helper_endgame;
+    int helper_max_depth;
+
+    // Set by stop() to end the search running on another thread early
+    int stop_requested;
+
+    // Pondering: after our move, a thread searches the position after the
+    // opponent's expected reply (ponder_reply, or NO_MOVE if none is
+    // expected and it searches the opponent's position instead) until the
+    // opponent moves.
+    bool pondering;
+    pthread_t ponder_thread;
+    Board ponder_board;
+    Side ponder_side;
+    int ponder_reply;
+    int ponder_move;
+    int ponder_done;
+
+    Player(Player *master, int index);
+    Player(const Player &);
+    Player &operator=(const Player &);
+
+    void startHelpers(const Board &board, bool endgame, int max_depth);
+    void stopHelpers();
+    static void *runHelper(void *helper);
+    static void *runPonder(void *player);
+    bool finishPondering(int opponents_move, int msLeft, int &best_move);
+    void logSearch(const Board &board, int move, bool pondered) const;
+
+    int iterativeDeepening(const Board &board, int max_depth,
+            long soft_limit);
+    int aspirationSearch(const Board &board, int depth, int guess,
+            int window, int &best_move);
+    int solveEndgame(const Board &board);
+    bool lookupSolved(uint64_t P, uint64_t O, int empties, int &best_move,
+            int &score);
+    void saveSolved(uint64_t P, uint64_t O, int empties, int best_move,
+            int score);
+    bool probCut(const Board &board, Side side, int depth, int lower_bound,
+            int &score);
+    int timeBudget(int msLeft, int empties);
+    void startClock(bool timed, long hard_limit);
+    bool outOfTime();
+    static long currentTimeMs();
+
+    uint64_t positionKey(const Board &board, Side side,
+            int &symmetry) const;
+    // Kinds of node the search is specialized for: principal variation
+    // nodes have an open window, all others a null one
+    enum NodeType {
+        PV_NODE,
+        NULL_WINDOW_NODE
+    };
+    template <NodeType NODE>
+    int search(const Board &board, Side side, int depth, int lower_bound,
+            int upper_bound, int &best_move);
+
+    int probe(uint64_t key, uint64_t moves, int depth, int &lower_bound,
+            int &upper_bound, int &score, int symmetry = 0);
+    void store(uint64_t key, int depth, int lower_bound, int upper_bound,
+            int score, int best_move, int symmetry = 0);
+    int storedMove(const Board &board, Side side) const;
+    int orderMoves(const Board &board, Side side, uint64_t moves,
+            int hash_move, int depth, int move_list[]);
+    void recordCutoff(const Board &board, Side side, int square, int depth,
+            int index);
+
+    template <NodeType NODE>
+    int solve(uint64_t P, uint64_t O, int alpha, int beta, int empties,
+            bool passed, int &best_move);
+    int orderEndgameMoves(uint64_t P, uint64_t O, uint64_t moves,
+            int hash_move, int empties, int move_list[]);
+    int solveLast(uint64_t P, uint64_t O, int alpha, int beta, int played);
+    int solve4(uint64_t P, uint64_t O, int alpha, int beta, int x1, int x2,
+            int x3, int x4, bool passed);
+    int solve3(uint64_t P, uint64_t O, int alpha, int beta, int x1, int x2,
+            int x3, bool passed);
+    int solve2(uint64_t P, uint64_t O, int alpha, int beta, int x1, int x2,
+            bool passed);
+    int solve1(uint64_t P, uint64_t O, int x);
 };
 
 #endif
@@ -0,0 +1,95 @@
+#include "probcut.h"
+#include <stdio.h>
+#include <string.h>
+
+ProbCut::ParamSet ProbCut::standard;
+const char *const ProbCut::PROBCUT_FILE = "probcut.txt";
+
+/**
+ * Returns the depth of the shallow search that predicts a search of the
+ * given depth: about half as deep, with the same parity.
+ */
+int ProbCut::shallowDepth(int depth) {
+    int shallow = depth / 2;
+    if ((shallow ^ depth) & 1) {
+        shallow--;
+    }
+    return shallow;
+}
+
+/**
+ * Returns the parameters in set for a search of the given depth of a
+ * position with the given number of discs, or NULL if it is not to be cut.
+ */
+const ProbCut::Params *ProbCut::lookup(int discs, int depth,
+        const ParamSet &set) {
+    if (depth < MIN_DEPTH || depth > MAX_DEPTH) {
+        return NULL;
+    }
+    const Params *p = &set.params[Patterns::stage(discs)][depth];
+    return (p->sigma > 0) ? p : NULL;
+}
+
+/**
+ * Forgets all parameters in set, so nothing is cut.
+ */
+void ProbCut::clear(ParamSet &set) {
+    memset(set.params, 0, sizeof(set.params));
+}
+
+/**
+ * Reads parameters into set from a file that save wrote, one stage and
+ * depth per line as key=value pairs:
+ *
+ *   stage=7 depth=8 shallow=4 a=0.9621 b=-0.87 sigma=11.42
+ *
+ * Lines that are not parameters are skipped. Returns false, leaving the
+ * parameters alone, if the file cannot be read.
+ */
+bool ProbCut::load(const char *filename, ParamSet &set) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return false;
+    }
+    clear(set);
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        int stage, depth, shallow;
+        double a, b, sigma;
+        if (sscanf(line, "stage=%d depth=%d shallow=%d a=%lf b=%lf sigma=%lf",
+                    &stage, &depth, &shallow, &a, &b, &sigma) == 6
+                && stage >= 0 && stage < Patterns::STAGES
+                && depth >= MIN_DEPTH && depth <= MAX_DEPTH
+                && shallow >= 0 && shallow < depth && a > 0 && sigma > 0) {
+            Params &p = set.params[stage][depth];
+            p.shallow = shallow;
+            p.a = a;
+            p.b = b;
+            p.sigma = sigma;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Writes the parameters in set to a file that load can read. Returns false
+ * if the file cannot be written.
+ */
+bool ProbCut::save(const char *filename, const ParamSet &set) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return false;
+    }
+    for (int stage = 0; stage < Patterns::STAGES; stage++) {
+        for (int depth = MIN_DEPTH; depth <= MAX_DEPTH; depth++) {
+            const Params &p = set.params[stage][depth];
+            if (p.sigma > 0) {
+                fprintf(file, "stage=%d depth=%d shallow=%d a=%.4f b=%.2f "
+                        "sigma=%.2f\n", stage, depth, p.shallow, p.a, p.b,
+                        p.sigma);
+            }
+        }
+    }
+    return fclose(file) == 0;
+}
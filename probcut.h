@@ -0,0 +1,53 @@
+#ifndef __PROBCUT_H__
+#define __PROBCUT_H__
+
+#include "pattern.h"
+
+/*
+ * Multi-ProbCut parameters. For every stage and search depth, the score of
+ * a search to that depth is predicted from a shallower one as
+ *
+ *   deep = a * shallow + b
+ *
+ * with a standard deviation sigma of the error. Each depth has its own
+ * shallow depth, of the same parity since the evaluation swings between
+ * odd and even depths. The parameters are fitted offline on the engine's
+ * own searches by "train probcut"; depths and stages without them are
+ * never cut. They only hold for the weights they were fitted with, so a
+ * player evaluating with other weights needs a parameter set of its own.
+ */
+class ProbCut {
+
+public:
+    // Depths that can be cut
+    static const int MIN_DEPTH = 3;
+    static const int MAX_DEPTH = 14;
+
+    struct Params {
+        int shallow;
+        double a;
+        double b;
+        // Zero if there are no parameters
+        double sigma;
+    };
+
+    struct ParamSet {
+        Params params[Patterns::STAGES][MAX_DEPTH + 1];
+    };
+
+    static int shallowDepth(int depth);
+    static const Params *lookup(int discs, int depth,
+            const ParamSet &set = standard);
+
+    static void clear(ParamSet &set = standard);
+    static bool load(const char *filename, ParamSet &set = standard);
+    static bool save(const char *filename, const ParamSet &set = standard);
+
+    // Parameters searched with unless a player is given others
+    static ParamSet standard;
+
+    // Default parameters file
+    static const char *const PROBCUT_FILE;
+};
+
+#endif
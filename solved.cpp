@@ -0,0 +1,313 @@
+#include "solved.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const char *const SolvedCache::INDEX_FILE = "solved.bin";
+const char *const SolvedCache::LOG_FILE = "solved.log";
+
+/*
+ * An index file starts with this and the number of entries as a 64-bit
+ * integer, in the machine's byte order; the entries follow. The log has no
+ * header.
+ */
+static const char INDEX_MAGIC[8] = {'N', 'o', 'o', 'b', 'S', 'l', 'v', '1'};
+static const size_t HEADER_BYTES = 16;
+
+static bool positionBefore(const SolvedEntry &a, const SolvedEntry &b) {
+    return a.own < b.own || (a.own == b.own && a.opp < b.opp);
+}
+
+static bool samePosition(const SolvedEntry &a, const SolvedEntry &b) {
+    return a.own == b.own && a.opp == b.opp;
+}
+
+/**
+ * Returns the number of entries in an index file with the given header and
+ * size, or -1 if it is not an index.
+ */
+static long indexCount(const void *header, size_t size) {
+    if (size < HEADER_BYTES
+            || memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC))) {
+        return -1;
+    }
+    uint64_t stored;
+    memcpy(&stored, (const char *) header + 8, sizeof(stored));
+    if (HEADER_BYTES + stored * sizeof(SolvedEntry) != size) {
+        return -1;
+    }
+    return (long) stored;
+}
+
+/**
+ * Makes an empty cache.
+ */
+SolvedCache::SolvedCache() {
+    mapping = NULL;
+    mapping_size = 0;
+    entries = NULL;
+    count = 0;
+    log_fd = -1;
+    writing = false;
+    closing = false;
+    pthread_mutex_init(&queue_lock, NULL);
+    pthread_cond_init(&queue_ready, NULL);
+}
+
+/**
+ * Destructor for the cache. Waits for queued positions to be written.
+ */
+SolvedCache::~SolvedCache() {
+    close();
+    pthread_cond_destroy(&queue_ready);
+    pthread_mutex_destroy(&queue_lock);
+}
+
+/**
+ * Opens a cache, closing any cache already open: maps the index, reads the
+ * log, and starts the thread appending to the log. Either file may be
+ * missing, and an index that is not one is ignored. Returns false if the
+ * log cannot be opened for appending; the positions already on disk can
+ * still be looked up.
+ */
+bool SolvedCache::open(const char *index_file, const char *log_file) {
+    close();
+    int fd = ::open(index_file, O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (data != MAP_FAILED) {
+            long stored = indexCount(data, info.st_size);
+            if (stored >= 0) {
+                mapping = data;
+                mapping_size = info.st_size;
+                entries = (const SolvedEntry *)
+                    ((const char *) data + HEADER_BYTES);
+                count = stored;
+            } else {
+                munmap(data, info.st_size);
+            }
+        }
+    }
+
+    readLog(log_file, logged);
+    std::sort(logged.begin(), logged.end(), positionBefore);
+
+    log_fd = ::open(log_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd < 0) {
+        return false;
+    }
+    closing = false;
+    writing = pthread_create(&writer, NULL, runWriter, this) == 0;
+    return writing;
+}
+
+/**
+ * Writes out the positions still queued, then closes the log and unmaps
+ * the index.
+ */
+void SolvedCache::close() {
+    if (writing) {
+        pthread_mutex_lock(&queue_lock);
+        closing = true;
+        pthread_cond_signal(&queue_ready);
+        pthread_mutex_unlock(&queue_lock);
+        pthread_join(writer, NULL);
+        writing = false;
+    }
+    if (log_fd >= 0) {
+        ::close(log_fd);
+        log_fd = -1;
+    }
+    if (mapping != NULL) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = NULL;
+    mapping_size = 0;
+    entries = NULL;
+    count = 0;
+    logged.clear();
+}
+
+/**
+ * Returns the number of positions that can be looked up, counting one
+ * that is in both the index and the log twice.
+ */
+size_t SolvedCache::size() const {
+    return count + logged.size();
+}
+
+/**
+ * Looks up the position with own to move. Returns true, and sets square to
+ * the best move and score to the exact final disc difference for own, if
+ * it has been solved.
+ */
+bool SolvedCache::lookup(uint64_t own, uint64_t opp, int &square,
+        int &score) const {
+    if (count == 0 && logged.empty()) {
+        return false;
+    }
+    SolvedEntry wanted;
+    int symmetry;
+    Board::canonical(own, opp, symmetry);
+    wanted.own = own;
+    wanted.opp = opp;
+
+    const SolvedEntry *found = std::lower_bound(entries, entries + count,
+            wanted, positionBefore);
+    if (found == entries + count || !samePosition(*found, wanted)) {
+        std::vector<SolvedEntry>::const_iterator it = std::lower_bound(
+                logged.begin(), logged.end(), wanted, positionBefore);
+        if (it == logged.end() || !samePosition(*it, wanted)) {
+            return false;
+        }
+        found = &*it;
+    }
+    square = Board::untransformSquare(found->move, symmetry);
+    score = found->score;
+    return true;
+}
+
+/**
+ * Queues a solved position with own to move, its best move and exact
+ * score, to be appended to the log. Does nothing if the log is not open.
+ */
+void SolvedCache::add(uint64_t own, uint64_t opp, int square, int score) {
+    if (!writing) {
+        return;
+    }
+    SolvedEntry entry;
+    int symmetry;
+    Board::canonical(own, opp, symmetry);
+    entry.own = own;
+    entry.opp = opp;
+    entry.score = score;
+    entry.move = Board::transformSquare(square, symmetry);
+    memset(entry.reserved, 0, sizeof(entry.reserved));
+
+    pthread_mutex_lock(&queue_lock);
+    queue.push_back(entry);
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void *SolvedCache::runWriter(void *cache) {
+    ((SolvedCache *) cache)->writeQueue();
+    return NULL;
+}
+
+/**
+ * Body of the writer thread: appends queued positions to the log until
+ * the cache is closed and the queue is empty. Each batch is a single
+ * write, so engines sharing the log do not interleave entries.
+ */
+void SolvedCache::writeQueue() {
+    std::vector<SolvedEntry> batch;
+    pthread_mutex_lock(&queue_lock);
+    while (true) {
+        while (queue.empty() && !closing) {
+            pthread_cond_wait(&queue_ready, &queue_lock);
+        }
+        if (queue.empty()) {
+            break;
+        }
+        batch.swap(queue);
+        pthread_mutex_unlock(&queue_lock);
+        size_t bytes = batch.size() * sizeof(SolvedEntry);
+        if (::write(log_fd, &batch[0], bytes) != (ssize_t) bytes) {
+            perror("solved cache log");
+        }
+        batch.clear();
+        pthread_mutex_lock(&queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+}
+
+/**
+ * Appends the entries of a log file to entries, skipping a partly written
+ * last one. Returns false if the file cannot be read.
+ */
+bool SolvedCache::readLog(const char *filename,
+        std::vector<SolvedEntry> &entries) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    SolvedEntry entry;
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+        if ((entry.own & entry.opp) == 0) {
+            entries.push_back(entry);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Appends the entries of an index file to entries. Returns false if the
+ * file cannot be read or is not an index.
+ */
+bool SolvedCache::readIndex(const char *filename,
+        std::vector<SolvedEntry> &entries) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    char header[HEADER_BYTES];
+    struct stat info;
+    long stored = -1;
+    if (fread(header, sizeof(header), 1, file) == 1
+            && fstat(fileno(file), &info) == 0) {
+        stored = indexCount(header, info.st_size);
+    }
+    size_t start = entries.size();
+    if (stored > 0) {
+        entries.resize(start + stored);
+        if (fread(&entries[start], sizeof(SolvedEntry), stored, file)
+                != (size_t) stored) {
+            entries.resize(start);
+            stored = -1;
+        }
+    }
+    fclose(file);
+    return stored >= 0;
+}
+
+/**
+ * Sorts entries by position, drops repeated positions, and writes them to
+ * an index file. The file is written under a temporary name and renamed
+ * into place, so an engine never maps half an index. Returns false if it
+ * cannot be written.
+ */
+bool SolvedCache::write(const char *filename,
+        std::vector<SolvedEntry> &entries) {
+    std::sort(entries.begin(), entries.end(), positionBefore);
+    entries.erase(std::unique(entries.begin(), entries.end(), samePosition),
+            entries.end());
+
+    std::string temporary = std::string(filename) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    uint64_t stored = entries.size();
+    bool ok = fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC), 1, file) == 1
+        && fwrite(&stored, sizeof(stored), 1, file) == 1
+        && (entries.empty() || fwrite(&entries[0], sizeof(SolvedEntry),
+                entries.size(), file) == entries.size());
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), filename) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+#ifndef __SOLVED_H__
+#define __SOLVED_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+#include "board.h"
+
+/*
+ * A solved position: its canonical form (see Board::canonical), with the
+ * side to move's discs in own, and its exact final disc difference for
+ * that side and the best move on that form.
+ */
+struct SolvedEntry {
+    uint64_t own;
+    uint64_t opp;
+    int8_t score;
+    int8_t move;
+    uint8_t reserved[6];
+};
+
+/*
+ * Endgame positions solved in earlier games, kept on disk so they survive
+ * the engine being restarted for every game.
+ *
+ * The cache is two files. The index is a header followed by entries sorted
+ * by position, memory-mapped and binary-searched like the opening book.
+ * The log is a plain run of entries that engines append to as they solve;
+ * it is read into memory when the cache is opened. The mergesolved tool
+ * folds the log into the index offline, when no engine is running.
+ *
+ * Appends go through a queue to a thread of their own, so a move never
+ * waits on the disk. Lookups only see what was on disk when the cache was
+ * opened, and may run on any number of threads.
+ *
+ * The engine opens INDEX_FILE and LOG_FILE in the directory it runs in,
+ * creating the log if there is none, so every game played there adds to
+ * it. Only the position at the root of each solve with MIN_EMPTIES to
+ * MAX_EMPTIES empty squares is added, pondering included, so the log grows
+ * by a few dozen 24-byte entries a game at most; delete it, or fold it in
+ * with mergesolved, to keep it in check.
+ */
+class SolvedCache {
+
+private:
+    void *mapping;
+    size_t mapping_size;
+    const SolvedEntry *entries;
+    size_t count;
+    std::vector<SolvedEntry> logged;
+
+    int log_fd;
+    bool writing;
+    pthread_t writer;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    std::vector<SolvedEntry> queue;
+    bool closing;
+
+public:
+    // Positions with MIN_EMPTIES to MAX_EMPTIES empty squares are cached;
+    // fewer are quicker to solve than to look up
+    static const int MIN_EMPTIES = 12;
+    static const int MAX_EMPTIES = 30;
+
+    // Default index and log files
+    static const char *const INDEX_FILE;
+    static const char *const LOG_FILE;
+
+    SolvedCache();
+    ~SolvedCache();
+
+    bool open(const char *index_file, const char *log_file);
+    void close();
+    size_t size() const;
+
+    bool lookup(uint64_t own, uint64_t opp, int &square, int &score) const;
+    void add(uint64_t own, uint64_t opp, int square, int score);
+
+    static bool readLog(const char *filename,
+            std::vector<SolvedEntry> &entries);
+    static bool readIndex(const char *filename,
+            std::vector<SolvedEntry> &entries);
+    static bool write(const char *filename,
+            std::vector<SolvedEntry> &entries);
+
+private:
+    static void *runWriter(void *cache);
+    void writeQueue();
+
+    SolvedCache(const SolvedCache &);
+    SolvedCache &operator=(const SolvedCache &);
+};
+
+#endif
@@ -0,0 +1,791 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+#include "player.h"
+using namespace std;
+
+/*
+ * Offline training of the evaluation weights in Patterns, and of the
+ * Multi-ProbCut parameters that go with them.
+ *
+ *   train play <samples> [games] [threads]
+ *       Plays games against itself, starting from random openings, and
+ *       appends their positions to a samples file.
+ *
+ *   train label <games> <samples> [threads]
+ *       Replays game records, one game per line as a move list such as
+ *       "f5d6c3d3c4", and appends their positions to a samples file.
+ *
+ *   train fit <samples> <weights> [epochs] [threads]
+ *       Fits the pattern, mobility and stability weights to a samples file
+ *       by least squares, and writes them to a weights file. Symmetric
+ *       images of a pattern configuration share one weight.
+ *
+ *   train probcut <samples> <params> [positions] [depth] [threads]
+ *       Searches positions spread through a samples file to every depth up
+ *       to the given one, fits how well each depth's shallow search
+ *       predicts it per stage (see ProbCut), and writes the parameters to
+ *       a file for ProbCut::load. The searches evaluate with weights.bin if
+ *       there is one, as the engine does.
+ *
+ * Every position is labelled with the final disc difference for black. Once
+ * a game gets down to SOLVE_EMPTIES empty squares it is finished with
+ * perfect play from minimax_endgame, so the labels are the exact value of
+ * that position rather than the outcome of a shallow search's mistakes.
+ *
+ * A samples file is a stream of 17-byte records: the black and white
+ * bitboards, then the label as a signed byte. Both modes that make samples
+ * append to the file, and fit only ever holds one chunk of it in memory.
+ */
+
+static const int PLAY_DEPTH = 4;
+static const int RANDOM_MOVES = 10;
+static const int SOLVE_EMPTIES = 14;
+
+static const int SAMPLE_BYTES = 17;
+static const int CHUNK_SAMPLES = 1 << 16;
+// Every HOLDOUT-th sample is kept out of the fit to measure its error
+static const int HOLDOUT = 10;
+static const double LEARNING_RATE = 0.05;
+// Added to a weight's sample count, so rarely seen weights move slowly
+static const double REGULARIZATION = 10;
+
+static const int PROBCUT_POSITIONS = 2000;
+static const int PROBCUT_DEPTH = 10;
+// Fewest shallow and deep score pairs a stage and depth is fitted from
+static const int PROBCUT_MIN_PAIRS = 50;
+
+static long currentTimeMs() {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+struct Sample {
+    uint64_t black;
+    uint64_t white;
+    int score;
+};
+
+static void encodeSample(const Sample &sample, unsigned char *bytes) {
+    memcpy(bytes, &sample.black, 8);
+    memcpy(bytes + 8, &sample.white, 8);
+    bytes[16] = (unsigned char) (signed char) sample.score;
+}
+
+static void decodeSample(const unsigned char *bytes, Sample &sample) {
+    memcpy(&sample.black, bytes, 8);
+    memcpy(&sample.white, bytes + 8, 8);
+    sample.score = (signed char) bytes[16];
+}
+
+/*
+ * Work shared by the threads making samples: where game records come from
+ * (or how many games are left to play) and where samples go.
+ */
+struct GameSource {
+    pthread_mutex_t lock;
+    FILE *records;
+    int games_left;
+    unsigned long games;
+    FILE *out;
+    unsigned long samples;
+};
+
+/*
+ * Parses a move list into squares. Returns false if it holds anything but
+ * coordinates, whitespace and "--" or "pa" for passes.
+ */
+static bool parseGame(const char *line, vector<int> &moves) {
+    moves.clear();
+    for (const char *c = line; *c; ) {
+        if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+            c++;
+        } else if (!strncmp(c, "--", 2) || !strncmp(c, "pa", 2)
+                || !strncmp(c, "PA", 2)) {
+            c += 2;
+        } else {
+            int x = (*c >= 'a' && *c <= 'h') ? *c - 'a'
+                  : (*c >= 'A' && *c <= 'H') ? *c - 'A' : -1;
+            int y = c[1] - '1';
+            if (x < 0 || y < 0 || y > 7) {
+                return false;
+            }
+            moves.push_back(x + 8 * y);
+            c += 2;
+        }
+    }
+    return true;
+}
+
+/*
+ * Plays one game and fills samples with its positions, one per move made.
+ * The moves come from the record while it lasts, otherwise from random play
+ * for the first RANDOM_MOVES and a PLAY_DEPTH search after that, and from
+ * the endgame solver once SOLVE_EMPTIES squares are left. Returns false if
+ * the record holds an illegal move.
+ */
+static bool playGame(Player &player, const vector<int> *record,
+        unsigned int &seed, vector<Sample> &samples) {
+    Board board;
+    Side side = BLACK;
+    size_t ply = 0;
+    int black_score = 0;
+    bool solved = false;
+    samples.clear();
+
+    while (true) {
+        Side other = (side == BLACK) ? WHITE : BLACK;
+        uint64_t moves = board.moveMask(side);
+        if (moves == 0) {
+            if (board.moveMask(other) == 0) {
+                break;
+            }
+            side = other;
+            continue;
+        }
+
+        Sample sample;
+        sample.black = board.pieces(BLACK);
+        sample.white = board.pieces(WHITE);
+        samples.push_back(sample);
+
+        int square;
+        if (64 - board.countAll() <= SOLVE_EMPTIES) {
+            int score = player.minimax_endgame(board, side, -64, 64, square);
+            if (!solved) {
+                black_score = (side == BLACK) ? score : -score;
+                solved = true;
+            }
+        } else if (record != NULL && ply < record->size()) {
+            square = (*record)[ply];
+            if (!(moves & squareBit(square))) {
+                return false;
+            }
+        } else if (record == NULL && ply < (size_t) RANDOM_MOVES) {
+            seed = seed * 1103515245 + 12345;
+            int pick = (seed >> 16) % bitCount(moves);
+            while (pick--) {
+                moves &= moves - 1;
+            }
+            square = firstSquare(moves);
+        } else {
+            square = player.findMove(board, side, -1);
+        }
+        board.doMove(square, side);
+        side = other;
+        ply++;
+    }
+
+    if (!solved) {
+        black_score = board.score_endgame(BLACK);
+    }
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i].score = black_score;
+    }
+    return true;
+}
+
+static void *makeSamples(void *arg) {
+    GameSource *source = (GameSource *) arg;
+    Player player(BLACK);
+    player.search_depth = PLAY_DEPTH;
+    player.endgame_depth = 0;
+    vector<int> record;
+    vector<Sample> samples;
+    vector<unsigned char> bytes;
+    char line[1024];
+    unsigned int seed = 0;
+
+    while (true) {
+        // Claim the next game
+        bool have_game;
+        pthread_mutex_lock(&source->lock);
+        if (source->records != NULL) {
+            have_game = fgets(line, sizeof(line), source->records) != NULL;
+        } else {
+            have_game = source->games_left > 0;
+            source->games_left--;
+            seed = source->games_left + 1;
+        }
+        pthread_mutex_unlock(&source->lock);
+        if (!have_game) {
+            break;
+        }
+
+        if (source->records != NULL && !parseGame(line, record)) {
+            continue;
+        }
+        if (!playGame(player, source->records != NULL ? &record : NULL, seed,
+                samples)) {
+            continue;
+        }
+
+        bytes.resize(samples.size() * SAMPLE_BYTES);
+        for (size_t i = 0; i < samples.size(); i++) {
+            encodeSample(samples[i], &bytes[i * SAMPLE_BYTES]);
+        }
+        pthread_mutex_lock(&source->lock);
+        fwrite(&bytes[0], 1, bytes.size(), source->out);
+        source->games++;
+        source->samples += samples.size();
+        if (source->games % 1000 == 0) {
+            fprintf(stderr, "%lu games, %lu samples\n", source->games,
+                    source->samples);
+        }
+        pthread_mutex_unlock(&source->lock);
+    }
+    return NULL;
+}
+
+static int runGames(GameSource &source, int threads) {
+    pthread_mutex_init(&source.lock, NULL);
+    source.games = 0;
+    source.samples = 0;
+    long start = currentTimeMs();
+
+    vector<pthread_t> workers(threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, makeSamples, &source);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&source.lock);
+
+    printf("train=samples games=%lu samples=%lu time_ms=%ld\n", source.games,
+            source.samples, currentTimeMs() - start);
+    return 0;
+}
+
+/*
+ * Weights being fitted, in discs, and what one thread has gathered about
+ * them over an epoch: the summed error and the number of samples of every
+ * pattern weight, and the same for the mobility and stability weights.
+ */
+struct Model {
+    vector<double> weights[Patterns::STAGES];
+    double mobility[Patterns::STAGES];
+    double stability[Patterns::STAGES];
+};
+
+struct Gradient {
+    vector<double> error[Patterns::STAGES];
+    vector<int> count[Patterns::STAGES];
+    double mobility_error[Patterns::STAGES];
+    double mobility_norm[Patterns::STAGES];
+    double stability_error[Patterns::STAGES];
+    double stability_norm[Patterns::STAGES];
+    double train_error, test_error;
+    unsigned long train_count, test_count;
+
+    void reset(int size) {
+        for (int stage = 0; stage < Patterns::STAGES; stage++) {
+            error[stage].assign(size, 0);
+            count[stage].assign(size, 0);
+            mobility_error[stage] = 0;
+            mobility_norm[stage] = 0;
+            stability_error[stage] = 0;
+            stability_norm[stage] = 0;
+        }
+        train_error = test_error = 0;
+        train_count = test_count = 0;
+    }
+};
+
+struct FitJob {
+    const Model *model;
+    Gradient *gradient;
+    const unsigned char *bytes;
+    int count;
+    unsigned long first;
+};
+
+static void *fitChunk(void *arg) {
+    FitJob *job = (FitJob *) arg;
+    const Model &model = *job->model;
+    Gradient &gradient = *job->gradient;
+    uint16_t indices[Patterns::INSTANCES];
+    Board board;
+
+    for (int i = 0; i < job->count; i++) {
+        Sample sample;
+        decodeSample(job->bytes + i * SAMPLE_BYTES, sample);
+        board.setBoard(sample.black, sample.white);
+        Patterns::index(sample.black, sample.white, indices);
+        int stage = Patterns::stage(board.countAll());
+        const vector<double> &weights = model.weights[stage];
+
+        double mobility = board.mobility(BLACK) / 100;
+        double stability = board.stability(BLACK);
+        double prediction = model.mobility[stage] * mobility
+            + model.stability[stage] * stability;
+        for (int k = 0; k < Patterns::INSTANCES; k++) {
+            prediction += weights[Patterns::instance_offset[k] + indices[k]];
+        }
+        double error = sample.score - prediction;
+
+        if ((job->first + i) % HOLDOUT == 0) {
+            gradient.test_error += error * error;
+            gradient.test_count++;
+            continue;
+        }
+        gradient.train_error += error * error;
+        gradient.train_count++;
+        for (int k = 0; k < Patterns::INSTANCES; k++) {
+            int w = Patterns::instance_offset[k] + indices[k];
+            gradient.error[stage][w] += error;
+            gradient.count[stage][w]++;
+        }
+        gradient.mobility_error[stage] += error * mobility;
+        gradient.mobility_norm[stage] += mobility * mobility;
+        gradient.stability_error[stage] += error * stability;
+        gradient.stability_norm[stage] += stability * stability;
+    }
+    return NULL;
+}
+
+/*
+ * Index of the same pattern configuration with the colours swapped, for
+ * every weight. A weight and its colour swap are fitted together and kept
+ * opposite, since the evaluation is for black.
+ */
+static vector<int> colourSwaps() {
+    vector<int> swaps(Patterns::type_offset[Patterns::TYPES]);
+    for (int type = 0; type < Patterns::TYPES; type++) {
+        int offset = Patterns::type_offset[type];
+        for (int index = 0; index < Patterns::type_size[type]; index++) {
+            int swapped = 0, power = 1;
+            for (int digits = index; power < Patterns::type_size[type];
+                    digits /= 3, power *= 3) {
+                int digit = digits % 3;
+                swapped += (digit == 0 ? 0 : 3 - digit) * power;
+            }
+            swaps[offset + index] = offset + swapped;
+        }
+    }
+    return swaps;
+}
+
+/*
+ * Weights whose configurations are symmetric images of each other, in
+ * groups, and the group of every weight. A group is fitted as one weight,
+ * so the trained tables evaluate symmetric boards the same and the search
+ * can share their transposition table entries.
+ */
+static vector<int> symmetryGroups(vector<vector<int> > &groups) {
+    int size = Patterns::type_offset[Patterns::TYPES];
+    vector<int> group_of(size, -1);
+    for (int type = 0; type < Patterns::TYPES; type++) {
+        int offset = Patterns::type_offset[type];
+        for (int index = 0; index < Patterns::type_size[type]; index++) {
+            if (group_of[offset + index] >= 0) {
+                continue;
+            }
+            vector<int> group(1, offset + index);
+            group_of[offset + index] = groups.size();
+            for (size_t i = 0; i < group.size(); i++) {
+                for (int symmetry = 1; symmetry < 8; symmetry++) {
+                    int w = offset + Patterns::symmetricIndex(type,
+                            group[i] - offset, symmetry);
+                    if (group_of[w] < 0) {
+                        group_of[w] = groups.size();
+                        group.push_back(w);
+                    }
+                }
+            }
+            groups.push_back(group);
+        }
+    }
+    return group_of;
+}
+
+static int16_t toStored(double discs) {
+    double value = discs * Patterns::UNITS_PER_DISC * Patterns::SCALE;
+    value = (value < 0) ? value - 0.5 : value + 0.5;
+    if (value > 32767) {
+        return 32767;
+    }
+    if (value < -32767) {
+        return -32767;
+    }
+    return (int16_t) value;
+}
+
+static int fit(const char *samples_file, const char *weights_file,
+        int epochs, int threads) {
+    FILE *file = fopen(samples_file, "rb");
+    if (file == NULL) {
+        cerr << "cannot open " << samples_file << endl;
+        return 1;
+    }
+
+    Patterns::init();
+    int size = Patterns::type_offset[Patterns::TYPES];
+    vector<int> swaps = colourSwaps();
+    vector<vector<int> > groups;
+    vector<int> group_of = symmetryGroups(groups);
+    Model model;
+    for (int stage = 0; stage < Patterns::STAGES; stage++) {
+        model.weights[stage].assign(size, 0);
+        model.mobility[stage] = 0;
+        model.stability[stage] = 0;
+    }
+    vector<Gradient> gradients(threads);
+    vector<unsigned char> chunk(CHUNK_SAMPLES * SAMPLE_BYTES);
+    vector<pthread_t> workers(threads);
+    vector<FitJob> jobs(threads);
+
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        long start = currentTimeMs();
+        for (int t = 0; t < threads; t++) {
+            gradients[t].reset(size);
+        }
+
+        // Stream the samples a chunk at a time, split among the threads
+        rewind(file);
+        unsigned long first = 0;
+        size_t read;
+        while ((read = fread(&chunk[0], SAMPLE_BYTES, CHUNK_SAMPLES, file))
+                > 0) {
+            int per_thread = (read + threads - 1) / threads;
+            for (int t = 0; t < threads; t++) {
+                int begin = t * per_thread;
+                int end = begin + per_thread < (int) read
+                        ? begin + per_thread : (int) read;
+                jobs[t].model = &model;
+                jobs[t].gradient = &gradients[t];
+                jobs[t].bytes = &chunk[begin * SAMPLE_BYTES];
+                jobs[t].count = end > begin ? end - begin : 0;
+                jobs[t].first = first + begin;
+                pthread_create(&workers[t], NULL, fitChunk, &jobs[t]);
+            }
+            for (int t = 0; t < threads; t++) {
+                pthread_join(workers[t], NULL);
+            }
+            first += read;
+        }
+
+        // Gather the threads' sums into the first
+        Gradient &total = gradients[0];
+        for (int t = 1; t < threads; t++) {
+            for (int stage = 0; stage < Patterns::STAGES; stage++) {
+                for (int w = 0; w < size; w++) {
+                    total.error[stage][w] += gradients[t].error[stage][w];
+                    total.count[stage][w] += gradients[t].count[stage][w];
+                }
+                total.mobility_error[stage]
+                        += gradients[t].mobility_error[stage];
+                total.mobility_norm[stage]
+                        += gradients[t].mobility_norm[stage];
+                total.stability_error[stage]
+                        += gradients[t].stability_error[stage];
+                total.stability_norm[stage]
+                        += gradients[t].stability_norm[stage];
+            }
+            total.train_error += gradients[t].train_error;
+            total.train_count += gradients[t].train_count;
+            total.test_error += gradients[t].test_error;
+            total.test_count += gradients[t].test_count;
+        }
+
+        // Move every group of symmetric weights by its mean error, scaled
+        // down by the learning rate since each sample's error is shared by
+        // all its weights. The group of colour swaps moves the other way.
+        for (int stage = 0; stage < Patterns::STAGES; stage++) {
+            vector<double> &weights = model.weights[stage];
+            for (size_t g = 0; g < groups.size(); g++) {
+                const vector<int> &group = groups[g];
+                size_t s = group_of[swaps[group[0]]];
+                if (s <= g) {
+                    // Done with the swapped group, or its own colour swap
+                    // and so always zero
+                    continue;
+                }
+                const vector<int> &swapped = groups[s];
+                double error = 0;
+                int count = 0;
+                for (size_t i = 0; i < group.size(); i++) {
+                    error += total.error[stage][group[i]];
+                    count += total.count[stage][group[i]];
+                }
+                for (size_t i = 0; i < swapped.size(); i++) {
+                    error -= total.error[stage][swapped[i]];
+                    count += total.count[stage][swapped[i]];
+                }
+                double weight = weights[group[0]]
+                    + LEARNING_RATE * error / (count + REGULARIZATION);
+                for (size_t i = 0; i < group.size(); i++) {
+                    weights[group[i]] = weight;
+                }
+                for (size_t i = 0; i < swapped.size(); i++) {
+                    weights[swapped[i]] = -weight;
+                }
+            }
+            if (total.mobility_norm[stage] > 0) {
+                model.mobility[stage] += LEARNING_RATE
+                        * total.mobility_error[stage]
+                        / total.mobility_norm[stage];
+            }
+            if (total.stability_norm[stage] > 0) {
+                model.stability[stage] += LEARNING_RATE
+                        * total.stability_error[stage]
+                        / total.stability_norm[stage];
+            }
+        }
+
+        for (int stage = 0; stage < Patterns::STAGES; stage++) {
+            for (int w = 0; w < size; w++) {
+                Patterns::standard.weights[stage][w]
+                        = toStored(model.weights[stage][w]);
+            }
+            Patterns::standard.mobility[stage]
+                    = toStored(model.mobility[stage]);
+            Patterns::standard.stability[stage]
+                    = toStored(model.stability[stage]);
+        }
+        if (!Patterns::save(weights_file)) {
+            cerr << "cannot write " << weights_file << endl;
+            fclose(file);
+            return 1;
+        }
+
+        printf("train=fit epoch=%d samples=%lu train_rmse=%.3f "
+                "test_rmse=%.3f time_ms=%ld\n", epoch, first,
+                total.train_count
+                    ? sqrt(total.train_error / total.train_count) : 0.0,
+                total.test_count
+                    ? sqrt(total.test_error / total.test_count) : 0.0,
+                currentTimeMs() - start);
+        fflush(stdout);
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Work shared by the threads searching for probcut: which sample is next,
+ * and the pairs of shallow and deep scores found per stage and depth.
+ */
+struct ProbCutData {
+    pthread_mutex_t lock;
+    FILE *samples;
+    unsigned long stride;
+    unsigned long next;
+    unsigned long positions;
+    unsigned long done;
+    int max_depth;
+    vector<double> shallow[Patterns::STAGES][ProbCut::MAX_DEPTH + 1];
+    vector<double> deep[Patterns::STAGES][ProbCut::MAX_DEPTH + 1];
+};
+
+static void *searchProbCut(void *arg) {
+    ProbCutData *data = (ProbCutData *) arg;
+    Player player(BLACK);
+    player.selectivity = 0;
+    Board board;
+    unsigned char bytes[SAMPLE_BYTES];
+    int scores[ProbCut::MAX_DEPTH + 1];
+
+    while (true) {
+        pthread_mutex_lock(&data->lock);
+        bool have_sample = data->next < data->positions
+            && fseek(data->samples, (long) (data->next * data->stride)
+                    * SAMPLE_BYTES, SEEK_SET) == 0
+            && fread(bytes, SAMPLE_BYTES, 1, data->samples) == 1;
+        data->next++;
+        pthread_mutex_unlock(&data->lock);
+        if (!have_sample) {
+            break;
+        }
+
+        // Samples do not say whose move it is; without passes, black moves
+        // with an even number of discs on the board
+        Sample sample;
+        decodeSample(bytes, sample);
+        board.setBoard(sample.black, sample.white);
+        Side side = (board.countAll() % 2 == 0) ? BLACK : WHITE;
+        if (board.moveMask(side) == 0) {
+            side = (side == BLACK) ? WHITE : BLACK;
+            if (board.moveMask(side) == 0) {
+                continue;
+            }
+        }
+
+        int garbage;
+        player.tt->clear();
+        for (int depth = 1; depth <= data->max_depth; depth++) {
+            scores[depth] = player.minimax(board, side, depth, -1000000,
+                    +1000000, garbage);
+        }
+
+        int stage = Patterns::stage(board.countAll());
+        pthread_mutex_lock(&data->lock);
+        for (int depth = ProbCut::MIN_DEPTH; depth <= data->max_depth;
+                depth++) {
+            data->shallow[stage][depth].push_back(
+                    scores[ProbCut::shallowDepth(depth)]);
+            data->deep[stage][depth].push_back(scores[depth]);
+        }
+        data->done++;
+        if (data->done % 100 == 0) {
+            fprintf(stderr, "%lu positions\n", data->done);
+        }
+        pthread_mutex_unlock(&data->lock);
+    }
+    return NULL;
+}
+
+static int fitProbCut(const char *samples_file, const char *params_file,
+        int positions, int max_depth, int threads) {
+    ProbCutData data;
+    data.samples = fopen(samples_file, "rb");
+    if (data.samples == NULL) {
+        cerr << "cannot open " << samples_file << endl;
+        return 1;
+    }
+    if (max_depth > ProbCut::MAX_DEPTH) {
+        max_depth = ProbCut::MAX_DEPTH;
+    }
+    fseek(data.samples, 0, SEEK_END);
+    unsigned long samples = ftell(data.samples) / SAMPLE_BYTES;
+    data.positions = (positions < (long) samples) ? positions : samples;
+    data.stride = data.positions ? samples / data.positions : 1;
+    data.next = 0;
+    data.done = 0;
+    data.max_depth = max_depth;
+    Patterns::load(Patterns::WEIGHTS_FILE);
+    long start = currentTimeMs();
+
+    pthread_mutex_init(&data.lock, NULL);
+    vector<pthread_t> workers(threads);
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, searchProbCut, &data);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&data.lock);
+    fclose(data.samples);
+
+    // Least squares line through each stage and depth's pairs
+    ProbCut::clear();
+    int fitted = 0;
+    for (int stage = 0; stage < Patterns::STAGES; stage++) {
+        for (int depth = ProbCut::MIN_DEPTH; depth <= max_depth; depth++) {
+            const vector<double> &x = data.shallow[stage][depth];
+            const vector<double> &y = data.deep[stage][depth];
+            int n = x.size();
+            if (n < PROBCUT_MIN_PAIRS) {
+                continue;
+            }
+            double mean_x = 0, mean_y = 0;
+            for (int i = 0; i < n; i++) {
+                mean_x += x[i];
+                mean_y += y[i];
+            }
+            mean_x /= n;
+            mean_y /= n;
+            double var_x = 0, cov = 0;
+            for (int i = 0; i < n; i++) {
+                var_x += (x[i] - mean_x) * (x[i] - mean_x);
+                cov += (x[i] - mean_x) * (y[i] - mean_y);
+            }
+            if (var_x <= 0 || cov <= 0) {
+                continue;
+            }
+            ProbCut::Params &p = ProbCut::standard.params[stage][depth];
+            p.shallow = ProbCut::shallowDepth(depth);
+            p.a = cov / var_x;
+            p.b = mean_y - p.a * mean_x;
+            double residuals = 0;
+            for (int i = 0; i < n; i++) {
+                double r = y[i] - (p.a * x[i] + p.b);
+                residuals += r * r;
+            }
+            p.sigma = sqrt(residuals / (n - 2));
+            if (p.sigma <= 0) {
+                // Both searches reach the end of the game: nothing to cut
+                p.sigma = 0;
+                continue;
+            }
+            printf("train=probcut stage=%d depth=%d shallow=%d a=%.4f "
+                    "b=%.2f sigma=%.2f pairs=%d\n", stage, depth, p.shallow,
+                    p.a, p.b, p.sigma, n);
+            fitted++;
+        }
+    }
+    if (!ProbCut::save(params_file)) {
+        cerr << "cannot write " << params_file << endl;
+        return 1;
+    }
+    printf("train=probcut positions=%lu fitted=%d time_ms=%ld\n", data.done,
+            fitted, currentTimeMs() - start);
+    return 0;
+}
+
+/*
+ * Returns the number of threads given as argument index, or 1 if there is
+ * none. A count below one, or one that is not a number, is taken as 1.
+ */
+static int threadsArg(int argc, char *argv[], int index) {
+    int threads = (argc > index) ? atoi(argv[index]) : 1;
+    return (threads < 1) ? 1 : threads;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && !strcmp(argv[1], "play")) {
+        GameSource source;
+        source.records = NULL;
+        source.games_left = (argc >= 4) ? atoi(argv[3]) : 1000;
+        source.out = fopen(argv[2], "ab");
+        if (source.out == NULL) {
+            cerr << "cannot open " << argv[2] << endl;
+            return 1;
+        }
+        int result = runGames(source, threadsArg(argc, argv, 4));
+        fclose(source.out);
+        return result;
+    }
+    if (argc >= 4 && !strcmp(argv[1], "label")) {
+        GameSource source;
+        source.records = fopen(argv[2], "r");
+        if (source.records == NULL) {
+            cerr << "cannot open " << argv[2] << endl;
+            return 1;
+        }
+        source.out = fopen(argv[3], "ab");
+        if (source.out == NULL) {
+            cerr << "cannot open " << argv[3] << endl;
+            return 1;
+        }
+        int result = runGames(source, threadsArg(argc, argv, 4));
+        fclose(source.records);
+        fclose(source.out);
+        return result;
+    }
+    if (argc >= 4 && !strcmp(argv[1], "fit")) {
+        return fit(argv[2], argv[3], (argc >= 5) ? atoi(argv[4]) : 100,
+                threadsArg(argc, argv, 5));
+    }
+
+    if (argc >= 4 && !strcmp(argv[1], "probcut")) {
+        return fitProbCut(argv[2], argv[3],
+                (argc >= 5) ? atoi(argv[4]) : PROBCUT_POSITIONS,
+                (argc >= 6) ? atoi(argv[5]) : PROBCUT_DEPTH,
+                threadsArg(argc, argv, 6));
+    }
+
+    cerr << "usage: " << argv[0] << " play <samples> [games] [threads]" << endl
+        << "       " << argv[0] << " label <games> <samples> [threads]" << endl
+        << "       " << argv[0] << " fit <samples> <weights> [epochs] [threads]"
+        << endl
+        << "       " << argv[0]
+        << " probcut <samples> <params> [positions] [depth] [threads]" << endl;
+    return 1;
+}
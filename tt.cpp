@@ -0,0 +1,108 @@
+#include "tt.h"
+#include <string.h>
+
+/**
+ * Makes a table using at most the given number of megabytes. The number of
+ * buckets is rounded down to a power of two so a key maps to its bucket
+ * with a mask.
+ */
+TranspositionTable::TranspositionTable(int megabytes) {
+    buckets = NULL;
+    resize(megabytes);
+}
+
+/**
+ * Destructor for the table.
+ */
+TranspositionTable::~TranspositionTable() {
+    delete[] buckets;
+}
+
+/**
+ * Reallocates the table for a new memory budget. All entries are lost.
+ */
+void TranspositionTable::resize(int megabytes) {
+    uint64_t bytes = (uint64_t) (megabytes > 0 ? megabytes : 1) << 20;
+    uint64_t count = 1;
+    while (2 * count * sizeof(Bucket) <= bytes) {
+        count *= 2;
+    }
+
+    delete[] buckets;
+    buckets = new Bucket[count];
+    mask = count - 1;
+    clear();
+}
+
+/**
+ * Forgets every stored position.
+ */
+void TranspositionTable::clear() {
+    memset(buckets, 0, (mask + 1) * sizeof(Bucket));
+    age = 0;
+}
+
+/**
+ * Marks the start of a new search, so entries left over from earlier
+ * searches are the first to be replaced.
+ */
+void TranspositionTable::newSearch() {
+    age++;
+}
+
+/**
+ * Looks up a position. Returns true and fills in entry if it is stored.
+ */
+bool TranspositionTable::probe(uint64_t key, TTEntry &entry) const {
+    const Bucket &bucket = buckets[key & mask];
+    if (read(bucket.deep, entry) && entry.key == key) {
+        return true;
+    }
+    return read(bucket.recent, entry) && entry.key == key;
+}
+
+/**
+ * Stores a search result. The depth-preferred slot takes it if the slot
+ * holds the same position, a shallower search or one from an older search;
+ * otherwise it goes in the always-replace slot.
+ */
+void TranspositionTable::store(uint64_t key, int depth, Bound bound,
+        int score, int move) {
+    Bucket &bucket = buckets[key & mask];
+    TTEntry entry;
+    entry.key = key;
+    entry.score = score;
+    entry.depth = depth;
+    entry.bound = bound;
+    entry.move = move;
+    entry.age = age;
+
+    TTEntry deep;
+    if (!read(bucket.deep, deep) || deep.key == key || depth >= deep.depth
+            || deep.age != age) {
+        write(bucket.deep, entry);
+    } else {
+        write(bucket.recent, entry);
+    }
+}
+
+/**
+ * Reads a slot into entry. Returns false if the slot is empty.
+ */
+bool TranspositionTable::read(const Slot &slot, TTEntry &entry) {
+    uint64_t check = __atomic_load_n(&slot.check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&slot.data, __ATOMIC_RELAXED);
+    entry.key = check ^ data;
+    memcpy(&entry.score, &data, sizeof(data));
+    return entry.bound != BOUND_NONE;
+}
+
+/**
+ * Overwrites a slot with an entry.
+ */
+void TranspositionTable::write(Slot &slot, const TTEntry &entry) {
+    uint64_t data;
+    memcpy(&data, &entry.score, sizeof(data));
+    __atomic_store_n(&slot.check, entry.key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot.data, data, __ATOMIC_RELAXED);
+}
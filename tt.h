@@ -0,0 +1,77 @@
+#ifndef __TT_H__
+#define __TT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * What an entry's score says about the true score of its position.
+ */
+enum Bound {
+    BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT
+};
+
+/*
+ * A stored search result. Everything after the key packs into one 64-bit
+ * word.
+ */
+struct TTEntry {
+    uint64_t key;
+    int32_t score;
+    int8_t depth;
+    uint8_t bound;
+    int8_t move;
+    uint8_t age;
+};
+
+/*
+ * Fixed-size hash table of search results. Each bucket holds one
+ * depth-preferred entry, which is only replaced by a deeper (or newer)
+ * search of another position, and one entry that is always replaced.
+ *
+ * The table may be shared by search threads without locking. A slot keeps
+ * its key XORed with its data, so a slot torn by two threads writing it at
+ * once no longer matches any key and reads as empty.
+ */
+class TranspositionTable {
+
+private:
+    struct Slot {
+        uint64_t check;
+        uint64_t data;
+    };
+
+    struct Bucket {
+        Slot deep;
+        Slot recent;
+    };
+
+    Bucket *buckets;
+    uint64_t mask;
+    uint8_t age;
+
+public:
+    /*
+     * Memory budget used by a Player unless told otherwise.
+     */
+    static const int DEFAULT_MEGABYTES = 32;
+
+    TranspositionTable(int megabytes = DEFAULT_MEGABYTES);
+    ~TranspositionTable();
+
+    void resize(int megabytes);
+    void clear();
+    void newSearch();
+
+    bool probe(uint64_t key, TTEntry &entry) const;
+    void store(uint64_t key, int depth, Bound bound, int score, int move);
+
+private:
+    static bool read(const Slot &slot, TTEntry &entry);
+    static void write(Slot &slot, const TTEntry &entry);
+
+    TranspositionTable(const TranspositionTable &);
+    TranspositionTable &operator=(const TranspositionTable &);
+};
+
+#endif
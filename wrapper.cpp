@@ -2,18 +2,74 @@
 #include <cstdlib>
 #include <cstring>
 #include "player.h"
+#include "batch.h"
+#include "engine.h"
 using namespace std;
 
 int main(int argc, char *argv[]) {    
-    // Read in side the player is on.
-    if (argc != 2)  {
-        cerr << "usage: " << argv[0] << " side" << endl;
+    // Analyze positions from stdin instead of playing a game.
+    if (argc >= 2 && !strcmp(argv[1], "--batch")) {
+        Patterns::load(Patterns::WEIGHTS_FILE);
+        ProbCut::load(ProbCut::PROBCUT_FILE);
+        return runBatch((argc >= 3) ? atoi(argv[2]) : Player::DEPTH,
+                (argc >= 4) ? atoi(argv[3]) : 1,
+                (argc >= 5) ? atoi(argv[4]) : 0, Player::DEPTH_ENDGAME);
+    }
+
+    // Take commands from stdin for as many games as there are.
+    if (argc >= 2 && !strcmp(argv[1], "--engine")) {
+        Patterns::load(Patterns::WEIGHTS_FILE);
+        ProbCut::load(ProbCut::PROBCUT_FILE);
+        Player player(BLACK);
+        if (argc >= 3) {
+            player.setThreads(atoi(argv[2]));
+        }
+        OpeningBook book;
+        if (book.open(OpeningBook::BOOK_FILE)) {
+            player.book = &book;
+        }
+        SolvedCache solved;
+        solved.open(SolvedCache::INDEX_FILE, SolvedCache::LOG_FILE);
+        player.solved = &solved;
+        return runEngine(&player);
+    }
+
+    // Read in side the player is on, optionally how many threads to
+    // search with, and whether to think on the opponent's time.
+    bool ponder = argc == 4 && !strcmp(argv[3], "ponder");
+    if (argc != 2 && argc != 3 && !ponder)  {
+        cerr << "usage: " << argv[0] << " side [threads [ponder]]" << endl
+            << "       " << argv[0] << " --batch [depth [threads [ms]]]"
+            << endl
+            << "       " << argv[0] << " --engine [threads]" << endl;
         exit(-1);
     }
     Side side = (!strcmp(argv[1], "Black")) ? BLACK : WHITE;
 
-    // Initialize player.
+    // Use trained evaluation weights if there are any, and the
+    // Multi-ProbCut parameters fitted for them.
+    Patterns::load(Patterns::WEIGHTS_FILE);
+    ProbCut::load(ProbCut::PROBCUT_FILE);
+
+    // Initialize player, which reports on each search on stderr.
     Player *player = new Player(side);
+    player->log_search = true;
+    if (argc >= 3) {
+        player->setThreads(atoi(argv[2]));
+    }
+
+    // Play from the opening book if there is one.
+    OpeningBook book;
+    if (book.open(OpeningBook::BOOK_FILE)) {
+        player->book = &book;
+    }
+
+    // Keep endgame solves from one game to the next, in solved.bin and
+    // solved.log in the current directory (see SolvedCache); the positions
+    // already solved can be looked up even if more cannot be added.
+    SolvedCache solved;
+    solved.open(SolvedCache::INDEX_FILE, SolvedCache::LOG_FILE);
+    player->solved = &solved;
 
     // Tell java wrapper that we are done initializing.
     cout << "Init done" << endl;
@@ -37,11 +93,16 @@ int main(int argc, char *argv[]) {
         }
         cout.flush();
         cerr.flush();
+
+        if (ponder) {
+            player->startPondering();
+        }
         
         // Delete move objects.
         if (opponentsMove != NULL) delete opponentsMove;
         if (playersMove != NULL) delete playersMove; 
     }
 
+    player->stopPondering();
     return 0;
 }